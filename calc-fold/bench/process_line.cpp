@@ -0,0 +1,208 @@
+#include "calc.h"
+
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// Measures the throughput of process_line, process_stream and Program on
+// line mixes: single operations, short and long folds, lines with errors,
+// SQRT and ^. Error messages of process_line go to a discarding stream,
+// so the numbers show the cost of parsing and formatting, not of a terminal.
+// Program runs the same lines without SETs, per MiB of that text.
+// The LEFT, PAIRWISE and KAHAN columns are process_stream with FoldOptions:
+// a few threads and pieces of 4 KiB, so long folds are split.
+// Usage: calc_bench [lines] [threads]
+
+namespace {
+
+struct Workload
+{
+    std::string name;
+    std::vector<std::string> lines;
+    std::string text; // lines joined by '\n'
+    // The text without SET lines: Program folds everything after a SET
+    // into constants, and run() would only replay the result
+    std::string program_text;
+};
+
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(const int c) override
+    {
+        return c;
+    }
+};
+
+// Keeps every result alive without storing it
+class CountingSink : public calc::Sink
+{
+public:
+    double sum = 0;
+    std::size_t errors = 0;
+
+    void result(const double value) override
+    {
+        sum += value;
+    }
+
+    void error(const calc::Diagnostic &) override
+    {
+        ++errors;
+    }
+};
+
+class Generator
+{
+public:
+    explicit Generator(const std::uint32_t seed)
+        : engine(seed)
+    {
+    }
+
+    std::string number()
+    {
+        return std::to_string(uniform(0, 99999)) + "." + std::to_string(uniform(0, 9999));
+    }
+
+    std::string fold(const char * op, const std::size_t count)
+    {
+        std::string line = op;
+        for (std::size_t k = 0; k < count; ++k) {
+            line += ' ';
+            line += number();
+        }
+        return line;
+    }
+
+    std::size_t uniform(const std::size_t from, const std::size_t to)
+    {
+        return std::uniform_int_distribution<std::size_t>(from, to)(engine);
+    }
+
+private:
+    std::mt19937 engine;
+};
+
+Workload make(const std::string & name, const std::size_t lines, Generator & generator, std::string (*line)(Generator &))
+{
+    Workload workload{name, {}, {}, {}};
+    for (std::size_t k = 0; k < lines; ++k) {
+        workload.lines.push_back(line(generator));
+        workload.text += workload.lines.back();
+        workload.text += '\n';
+        if (!std::isdigit(static_cast<unsigned char>(workload.lines.back().front()))) {
+            workload.program_text += workload.lines.back();
+            workload.program_text += '\n';
+        }
+    }
+    return workload;
+}
+
+std::vector<Workload> make_workloads(const std::size_t lines)
+{
+    Generator generator(42);
+    std::vector<Workload> workloads;
+    workloads.push_back(make("single ops", lines, generator, [](Generator & g) {
+        static const char * const ops[] = {"+ ", "- ", "* ", "/ ", "% ", ""};
+        return ops[g.uniform(0, 5)] + g.number();
+    }));
+    workloads.push_back(make("short folds", lines, generator, [](Generator & g) {
+        static const char * const ops[] = {"(+)", "(-)", "(*)", "(/)"};
+        return g.fold(ops[g.uniform(0, 3)], g.uniform(2, 8));
+    }));
+    workloads.push_back(make("long folds", lines / 100 + 1, generator, [](Generator & g) {
+        return g.fold(g.uniform(0, 1) == 0 ? "(+)" : "(*)", 1000);
+    }));
+    workloads.push_back(make("huge folds", lines / 10000 + 1, generator, [](Generator & g) {
+        return g.fold(g.uniform(0, 1) == 0 ? "(+)" : "(*)", 100000);
+    }));
+    workloads.push_back(make("errors", lines, generator, [](Generator & g) {
+        static const char * const lines[] = {"x", "+ 1.2.3x", "/ 0", "(+) 1 2 a", "SQRT 4", "(+", "+ 12345678901", "(/) 1 0 2"};
+        return std::string(lines[g.uniform(0, 7)]);
+    }));
+    workloads.push_back(make("SQRT and ^", lines, generator, [](Generator & g) {
+        switch (g.uniform(0, 3)) {
+        case 0: return std::string("SQRT");
+        case 1: return "^ 0." + std::to_string(g.uniform(1, 9));
+        case 2: return std::string("(^) 1.0001 0.5");
+        default: return "+ " + g.number();
+        }
+    }));
+    workloads.push_back(make("mixed", lines, generator, [](Generator & g) {
+        static const char * const ops[] = {"+ 1.5", "* 1.0001", "SQRT", "_", "(+) 1 2 3.25 4", "^ 1.01", "/ 0", "% 7", "bad"};
+        return std::string(ops[g.uniform(0, 8)]);
+    }));
+    return workloads;
+}
+
+template <class F>
+double measure(const std::string & text, F && f)
+{
+    // Short runs are repeated until they take long enough to be timed
+    std::size_t repeats = 0;
+    const auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed{};
+    do {
+        f();
+        ++repeats;
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed.count() < 0.2);
+    return text.size() * repeats / elapsed.count() / (1 << 20);
+}
+
+} // anonymous namespace
+
+int main(int argc, char ** argv)
+{
+    const std::size_t lines = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    const unsigned threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4;
+    const auto workloads = make_workloads(lines);
+
+    NullBuffer null_buffer;
+    auto * cerr_buffer = std::cerr.rdbuf(&null_buffer);
+    double checksum = 0;
+
+    std::cout << std::left << std::setw(14) << "workload" << std::right
+              << std::setw(14) << "process_line" << std::setw(16) << "process_stream"
+              << std::setw(14) << "Program::run" << std::setw(10) << "LEFT" << std::setw(10) << "PAIRWISE"
+              << std::setw(10) << "KAHAN" << "   (MiB/s, folds on " << threads << " threads)" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    for (const auto & workload : workloads) {
+        const double by_line = measure(workload.text, [&] {
+            double current = 0;
+            for (const auto & line : workload.lines) {
+                current = process_line(current, line);
+            }
+            checksum += current;
+        });
+        const double by_stream = measure(workload.text, [&] {
+            CountingSink sink;
+            checksum += calc::process_stream(0, workload.text, sink);
+        });
+        const calc::Program program(workload.program_text);
+        const double by_program = measure(workload.program_text, [&] {
+            CountingSink sink;
+            checksum += program.run(0, sink);
+        });
+        double folded[3];
+        for (const auto reduction : {calc::Reduction::LEFT, calc::Reduction::PAIRWISE, calc::Reduction::KAHAN}) {
+            folded[static_cast<int>(reduction)] = measure(workload.text, [&] {
+                CountingSink sink;
+                checksum += calc::process_stream(0, workload.text, sink, calc::FoldOptions{reduction, threads, 1 << 12});
+            });
+        }
+        std::cout << std::left << std::setw(14) << workload.name << std::right
+                  << std::setw(14) << by_line << std::setw(16) << by_stream << std::setw(14) << by_program
+                  << std::setw(10) << folded[0] << std::setw(10) << folded[1] << std::setw(10) << folded[2] << std::endl;
+    }
+
+    std::cerr.rdbuf(cerr_buffer);
+    std::cout << "checksum " << std::setprecision(6) << checksum << std::endl;
+}
@@ -0,0 +1,601 @@
+#include "calc.h"
+
+#include <cctype>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Differential harness: every entry point of calc_fold_lib is run on the
+// same input as a plain reference calculator, and results must be
+// bit-identical, error messages - the same text in the same order.
+// Checked: ::process_line, process_stream, process_line with FoldOptions
+// (LEFT must be exact, PAIRWISE/KAHAN must report the same errors, change
+// only (+) and (*) lines and sum (+) with KAHAN to within a couple of ulps),
+// Program::run for a register and for a column of registers.
+// Usage: calc_differential [iterations] [seed]
+// Built with CALC_LIBFUZZER it is a libFuzzer target instead.
+
+namespace reference {
+
+// The calculator as it was first written, one character at a time, with
+// numbers converted exactly by std::strtod and errors printed as they are
+// found. Do not optimise it: it is what the library is compared with.
+
+const std::size_t max_decimal_digits = 10;
+
+enum class Op
+{
+    ERR,
+    SET,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    REM,
+    NEG,
+    POW,
+    SQRT
+};
+
+std::size_t arity(const Op op)
+{
+    switch (op) {
+    case Op::ERR: return 0;
+    case Op::NEG: return 1;
+    case Op::SQRT: return 1;
+    default: return 2;
+    }
+}
+
+struct several_op
+{
+    Op op;
+    bool several_args;
+};
+
+char at(const std::string & line, const std::size_t i)
+{
+    return i < line.size() ? line[i] : '\0';
+}
+
+several_op parse_op(const std::string & line, std::size_t & i, std::ostream & err)
+{
+    several_op this_op;
+    this_op.several_args = false;
+    const auto rollback = [&i, &line, &err](const std::size_t n) {
+        i -= n;
+        err << "Unknown operation " << line << std::endl;
+        several_op this_op;
+        this_op.op = Op::ERR;
+        return this_op;
+    };
+    if (at(line, i) == '(') {
+        ++i;
+        if (at(line, i + 1) == ')') {
+            this_op.several_args = true;
+        }
+        else {
+            err << "Need bracket: '" << line << "'" << std::endl;
+            return rollback(1);
+        }
+    }
+    switch (at(line, i++)) {
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+        --i;
+        if (!this_op.several_args) {
+            this_op.op = Op::SET;
+            return this_op;
+        }
+        return rollback(1);
+    case '+': this_op.op = Op::ADD; return this_op;
+    case '-': this_op.op = Op::SUB; return this_op;
+    case '*': this_op.op = Op::MUL; return this_op;
+    case '/': this_op.op = Op::DIV; return this_op;
+    case '%': this_op.op = Op::REM; return this_op;
+    case '_': this_op.op = Op::NEG; return this_op;
+    case '^': this_op.op = Op::POW; return this_op;
+    case 'S':
+        if (at(line, i++) != 'Q') {
+            return rollback(2);
+        }
+        if (at(line, i++) != 'R') {
+            return rollback(3);
+        }
+        if (at(line, i++) != 'T') {
+            return rollback(4);
+        }
+        this_op.op = Op::SQRT;
+        return this_op;
+    default:
+        return rollback(1);
+    }
+}
+
+std::size_t skip_ws(const std::string & line, std::size_t i)
+{
+    while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i]))) {
+        ++i;
+    }
+    return i;
+}
+
+double parse_arg(const std::string & line, std::size_t & i, const bool several_args, std::ostream & err)
+{
+    std::string number = "0";
+    std::size_t count = 0;
+    bool good = true;
+    bool integer = true;
+    while (good && i < line.size() && count < max_decimal_digits) {
+        if (several_args && std::isspace(static_cast<unsigned char>(line[i]))) {
+            break;
+        }
+        if (std::isdigit(static_cast<unsigned char>(line[i]))) {
+            number += line[i];
+            ++i;
+            ++count;
+        }
+        else if (line[i] == '.') {
+            if (integer) {
+                number += '.';
+            }
+            integer = false;
+            ++i;
+        }
+        else {
+            good = false;
+        }
+    }
+    if (!good) {
+        err << "Argument parsing error at " << i << ": '" << line.substr(i) << "'" << std::endl;
+        return 0;
+    }
+    else if (i < line.size() && !several_args) {
+        err << "Argument isn't fully parsed, suffix left: '" << line.substr(i) << "'" << std::endl;
+        return 0;
+    }
+    return std::strtod(number.c_str(), nullptr);
+}
+
+double unary(const double current, const Op op, std::ostream & err)
+{
+    if (op == Op::NEG) {
+        return -current;
+    }
+    if (current > 0) {
+        return std::sqrt(current);
+    }
+    err << "Bad argument for SQRT: " << current << std::endl;
+    return current;
+}
+
+double binary(const Op op, const double left, const double right, std::ostream & err)
+{
+    switch (op) {
+    case Op::SET: return right;
+    case Op::ADD: return left + right;
+    case Op::SUB: return left - right;
+    case Op::MUL: return left * right;
+    case Op::DIV:
+        if (right != 0) {
+            return left / right;
+        }
+        err << "Bad right argument for division: " << right << std::endl;
+        return left;
+    case Op::REM:
+        if (std::abs(right) != 0) {
+            return std::fmod(left, right);
+        }
+        err << "Bad right argument for remainder: " << right << std::endl;
+        return left;
+    case Op::POW: return std::pow(left, right);
+    default: return left;
+    }
+}
+
+double process_line(const double current, const std::string & line, std::ostream & err)
+{
+    std::size_t i = 0;
+    bool error = false;
+    double this_number = current;
+    const auto this_op = parse_op(line, i, err);
+    switch (arity(this_op.op)) {
+    case 2:
+        do {
+            if (this_op.several_args) {
+                ++i; // steps over ')' first, then over one character after each argument
+            }
+            i = skip_ws(line, i);
+            const auto old_i = i;
+            const auto arg = parse_arg(line, i, this_op.several_args, err);
+            if (i == old_i) {
+                err << "No argument for a binary operation" << std::endl;
+                break;
+            }
+            else if ((this_op.op == Op::REM || this_op.op == Op::DIV) && arg == 0) {
+                error = true;
+            }
+            this_number = binary(this_op.op, this_number, arg, err);
+        } while (i < line.size() && this_op.several_args);
+        if (i < line.size() || error) {
+            return current;
+        }
+        return this_number;
+    case 1:
+        if (i < line.size()) {
+            err << "Unexpected suffix for a unary operation: '" << line.substr(i) << "'" << std::endl;
+            break;
+        }
+        return unary(current, this_op.op, err);
+    default: break;
+    }
+    return current;
+}
+
+// Arguments of a (+) fold that process_line accepts
+bool sum_arguments(const std::string & line, std::vector<double> & args)
+{
+    std::ostringstream err;
+    std::size_t i = 0;
+    const auto this_op = parse_op(line, i, err);
+    if (this_op.op != Op::ADD || !this_op.several_args) {
+        return false;
+    }
+    do {
+        ++i;
+        i = skip_ws(line, i);
+        const auto old_i = i;
+        args.push_back(parse_arg(line, i, true, err));
+        if (i == old_i) {
+            return false;
+        }
+    } while (i < line.size());
+    return err.str().empty();
+}
+
+} // namespace reference
+
+namespace {
+
+// Records everything as text: results as exact hexadecimal floats
+class Recorder : public calc::Sink
+{
+public:
+    std::string out;
+    std::string err;
+
+    void result(const double value) override
+    {
+        out += hex(value);
+    }
+
+    void error(const calc::Diagnostic & diagnostic) override
+    {
+        err += calc::describe(diagnostic);
+        err += '\n';
+    }
+
+    static std::string hex(const double value)
+    {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%016llx\n", static_cast<unsigned long long>(bits));
+        return buffer;
+    }
+};
+
+struct Expected
+{
+    std::vector<std::string> lines;
+    std::string out; // every intermediate result
+    std::string err;
+    double result;
+};
+
+std::vector<std::string> split_lines(const std::string_view text)
+{
+    std::vector<std::string> lines;
+    std::size_t begin = 0;
+    while (begin < text.size()) {
+        auto end = text.find('\n', begin);
+        if (end == std::string_view::npos) {
+            end = text.size();
+        }
+        lines.emplace_back(text.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return lines;
+}
+
+Expected run_reference(const double current, const std::string_view text)
+{
+    Expected expected;
+    expected.lines = split_lines(text);
+    expected.result = current;
+    std::ostringstream err;
+    for (const auto & line : expected.lines) {
+        expected.result = reference::process_line(expected.result, line, err);
+        expected.out += Recorder::hex(expected.result);
+    }
+    expected.err = err.str();
+    return expected;
+}
+
+std::size_t failures = 0;
+
+void check(const bool ok, const char * what, const std::string_view text, const std::string & expected, const std::string & actual)
+{
+    if (ok) {
+        return;
+    }
+    if (++failures <= 5) {
+        std::cerr << "MISMATCH in " << what << "\ninput:\n"
+                  << text << "\n--- expected:\n"
+                  << expected << "--- actual:\n"
+                  << actual << std::endl;
+    }
+}
+
+// Global process_line reports to std::cerr, which is captured for the call
+std::string run_process_line(double current, const std::vector<std::string> & lines, std::string & out)
+{
+    std::ostringstream err;
+    auto * old = std::cerr.rdbuf(err.rdbuf());
+    for (const auto & line : lines) {
+        current = process_line(current, line);
+        out += Recorder::hex(current);
+    }
+    std::cerr.rdbuf(old);
+    return err.str();
+}
+
+void check_text(const double current, const std::string_view text)
+{
+    const auto expected = run_reference(current, text);
+
+    {
+        std::string out;
+        const auto err = run_process_line(current, expected.lines, out);
+        check(out == expected.out, "process_line results", text, expected.out, out);
+        check(err == expected.err, "process_line errors", text, expected.err, err);
+    }
+    {
+        Recorder sink;
+        const double result = calc::process_stream(current, text, sink);
+        check(sink.out == expected.out, "process_stream results", text, expected.out, sink.out);
+        check(sink.err == expected.err, "process_stream errors", text, expected.err, sink.err);
+        check(Recorder::hex(result) == Recorder::hex(expected.result), "process_stream return", text, Recorder::hex(expected.result), Recorder::hex(result));
+    }
+    // Pieces as small as a few characters put a cut between almost every argument
+    for (const unsigned threads : {2u, 5u}) {
+        Recorder sink;
+        calc::process_stream(current, text, sink, calc::FoldOptions{calc::Reduction::LEFT, threads, 3});
+        check(sink.out == expected.out, "LEFT fold results", text, expected.out, sink.out);
+        check(sink.err == expected.err, "LEFT fold errors", text, expected.err, sink.err);
+    }
+    // Reassociated folds change values, so every line starts from the same register.
+    // The default min_piece keeps these lines on one thread.
+    for (const auto reduction : {calc::Reduction::PAIRWISE, calc::Reduction::KAHAN}) {
+        for (const auto & options : {calc::FoldOptions{reduction, 3, 3}, calc::FoldOptions{reduction}}) {
+            for (const auto & line : expected.lines) {
+                std::ostringstream err;
+                const auto exact = Recorder::hex(reference::process_line(current, line, err));
+                Recorder sink;
+                const double result = calc::process_line(current, line, sink, options);
+                check(sink.err == err.str(), "reassociated fold errors", line, err.str(), sink.err);
+                if (line.compare(0, 3, "(+)") != 0 && line.compare(0, 3, "(*)") != 0) {
+                    check(Recorder::hex(result) == exact, "reassociated fold results", line, exact, Recorder::hex(result));
+                }
+                std::vector<double> args;
+                if (reduction != calc::Reduction::KAHAN || !reference::sum_arguments(line, args)) {
+                    continue;
+                }
+                long double sum = current;
+                long double magnitude = std::fabs(current);
+                for (const double arg : args) {
+                    sum += arg;
+                    magnitude += std::fabs(arg);
+                }
+                if (!std::isfinite(static_cast<double>(magnitude))) {
+                    continue;
+                }
+                const double n = args.size() + 1;
+                const long double bound = 2 * DBL_EPSILON * std::fabs(sum) + n * (DBL_EPSILON * DBL_EPSILON + 2 * LDBL_EPSILON) * magnitude;
+                check(std::fabs(result - sum) <= bound, "KAHAN accuracy", line, Recorder::hex(static_cast<double>(sum)), Recorder::hex(result));
+            }
+        }
+    }
+    {
+        const calc::Program program(text);
+        Recorder sink;
+        const double result = program.run(current, sink);
+        check(Recorder::hex(result) == Recorder::hex(expected.result), "Program::run", text, Recorder::hex(expected.result), Recorder::hex(result));
+        check(sink.err == expected.err, "Program::run errors", text, expected.err, sink.err);
+    }
+}
+
+const double registers[] = {0, 1, -1, 0.5, -2.5, 3, 7.25, 1e-300, -1e300, 1e308, 123456789.125, HUGE_VAL, -HUGE_VAL, NAN};
+
+// Column lanes are compared with the reference run from each register
+void check_column(const std::string_view text)
+{
+    const std::size_t count = std::size(registers) * 3;
+    std::vector<double> column(count);
+    for (std::size_t k = 0; k < count; ++k) {
+        column[k] = registers[k % std::size(registers)];
+    }
+    std::vector<std::uint8_t> sqrt_failed(count);
+    calc::Program(text).run(column.data(), count, sqrt_failed.data(), 1);
+    for (std::size_t k = 0; k < count; ++k) {
+        const auto expected = run_reference(registers[k % std::size(registers)], text);
+        const auto expected_hex = Recorder::hex(expected.result);
+        const auto actual_hex = Recorder::hex(column[k]);
+        check(actual_hex == expected_hex, "Program column", text, expected_hex, actual_hex);
+        const bool failed = expected.err.find("Bad argument for SQRT") != std::string::npos;
+        check(failed == (sqrt_failed[k] != 0), "Program column SQRT flag", text, failed ? "failed\n" : "ok\n", sqrt_failed[k] != 0 ? "failed\n" : "ok\n");
+    }
+}
+
+class Generator
+{
+public:
+    explicit Generator(const std::uint32_t seed)
+        : engine(seed)
+    {
+    }
+
+    std::string text()
+    {
+        std::string result;
+        const auto lines = uniform(1, 12);
+        for (std::size_t k = 0; k < lines; ++k) {
+            result += line();
+            if (k + 1 < lines || chance(0.5)) {
+                result += '\n';
+            }
+        }
+        return result;
+    }
+
+private:
+    std::mt19937 engine;
+
+    std::size_t uniform(const std::size_t from, const std::size_t to)
+    {
+        return std::uniform_int_distribution<std::size_t>(from, to)(engine);
+    }
+
+    bool chance(const double p)
+    {
+        return std::bernoulli_distribution(p)(engine);
+    }
+
+    template <std::size_t N>
+    const char * pick(const char * const (&items)[N])
+    {
+        return items[uniform(0, N - 1)];
+    }
+
+    std::string digits(const std::size_t n)
+    {
+        std::string result;
+        for (std::size_t k = 0; k < n; ++k) {
+            result += static_cast<char>('0' + uniform(0, 9));
+        }
+        return result;
+    }
+
+    std::string number()
+    {
+        static const char * const odd[] = {"0", "0.0", ".", "1.2.3", "1e5", "abc", "-3", "007", "99999999999", "0.00000000001", "9999999999.9"};
+        const double p = std::uniform_real_distribution<double>(0, 1)(engine);
+        if (p < 0.15) {
+            return pick(odd);
+        }
+        if (p < 0.3) {
+            return digits(uniform(1, 14));
+        }
+        if (p < 0.4) {
+            return "." + digits(uniform(1, 12));
+        }
+        return digits(uniform(1, 6)) + "." + digits(uniform(0, 8));
+    }
+
+    std::string space()
+    {
+        static const char * const spaces[] = {" ", " ", " ", "  ", "\t", " \t"};
+        return pick(spaces);
+    }
+
+    std::string line()
+    {
+        static const char * const ops[] = {"+", "-", "*", "/", "%", "^", "_", "SQRT", "SQ", "SQR", "S", "", ")", "q", "SET", "(", "(+", "(x)", "(_)"};
+        static const char * const folds[] = {"(+)", "(-)", "(*)", "(/)", "(%)", "(^)"};
+        static const char * const suffixes[] = {"", "", "", " ", "  ", "x", "\t"};
+        if (chance(0.4)) {
+            std::string result = pick(folds);
+            const auto count = chance(0.2) ? uniform(20, 300) : uniform(0, 6);
+            for (std::size_t k = 0; k < count; ++k) {
+                if (k > 0 || chance(0.8)) {
+                    result += space();
+                }
+                result += chance(0.98) ? number() : pick(suffixes);
+            }
+            return result + pick(suffixes);
+        }
+        std::string result = pick(ops);
+        if (chance(0.7)) {
+            result += space();
+        }
+        if (chance(0.8)) {
+            result += number();
+        }
+        return result + pick(suffixes);
+    }
+};
+
+void check_all(const std::string_view text)
+{
+    for (const double current : {0.0, 2.0, -0.5}) {
+        check_text(current, text);
+    }
+    check_column(text);
+}
+
+} // anonymous namespace
+
+#if defined(CALC_LIBFUZZER)
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t * data, const std::size_t size)
+{
+    check_all(std::string_view(reinterpret_cast<const char *>(data), size));
+    if (failures != 0) {
+        std::abort();
+    }
+    return 0;
+}
+
+#else
+
+int main(int argc, char ** argv)
+{
+    const std::size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+    const auto seed = static_cast<std::uint32_t>(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : std::random_device()());
+    std::cout << "seed " << seed << ", " << iterations << " inputs" << std::endl;
+    Generator generator(seed);
+    // A fold KAHAN sums exactly and the left fold does not
+    std::string tenths = "(+) 1";
+    for (int k = 0; k < 1000; ++k) {
+        tenths += " 0.1";
+    }
+    check_all(tenths);
+    for (std::size_t k = 0; k < iterations && failures == 0; ++k) {
+        check_all(generator.text());
+    }
+    if (failures != 0) {
+        std::cout << "FAILED, rerun with: " << argv[0] << " " << iterations << " " << seed << std::endl;
+        return 1;
+    }
+    std::cout << "all results are bit-identical" << std::endl;
+    return 0;
+}
+
+#endif
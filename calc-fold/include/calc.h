@@ -1,5 +1,165 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
 #include <string>
+#include <string_view>
+#include <vector>
+
+namespace calc {
+
+enum class Error
+{
+    UNKNOWN_OPERATION,
+    NEED_BRACKET,
+    BAD_ARGUMENT,
+    ARGUMENT_SUFFIX,
+    NO_ARGUMENT,
+    UNARY_SUFFIX,
+    BAD_SQRT,
+    BAD_DIVISION,
+    BAD_REMAINDER
+};
+
+struct Diagnostic
+{
+    Error error;
+    std::string_view line; // valid only during the report
+    std::size_t position;  // where the problem is found in the line
+    double value;          // offending operand for BAD_SQRT, BAD_DIVISION, BAD_REMAINDER
+};
+
+// The message process_line prints for the diagnostic, without a newline
+std::string describe(const Diagnostic & diagnostic);
+
+// Receives the register value after every line and every error report
+class Sink
+{
+public:
+    virtual void result(double value) = 0;
+    virtual void error(const Diagnostic & diagnostic) = 0;
+
+    virtual ~Sink() = default;
+};
+
+// Formats results and error messages into reusable buffers and writes
+// them out in large chunks. With keep_order, only one buffer holds text at
+// a time, so results and errors stay in order when both streams go to the
+// same file; without it the two buffers fill and flush independently.
+class BufferedSink : public Sink
+{
+public:
+    BufferedSink(std::ostream & out, std::ostream & err, std::size_t capacity = 1 << 16, bool keep_order = true);
+
+    void result(double value) override;
+    void error(const Diagnostic & diagnostic) override;
+    void flush();
+
+    ~BufferedSink() override;
+
+private:
+    std::ostream & out;
+    std::ostream & err;
+    std::size_t capacity;
+    bool keep_order;
+    std::string out_buffer;
+    std::string err_buffer;
+
+    static void write(std::ostream & stream, std::string & buffer);
+};
+
+enum class Reduction
+{
+    LEFT,     // strict left fold, as process_line does
+    PAIRWISE, // (+) and (*) over a balanced tree, other folds stay LEFT
+    KAHAN     // (+) with compensated summation, (*) as PAIRWISE
+};
+
+// Opt-in evaluation of folds. Long argument lists are parsed in pieces on
+// several threads; with LEFT the result is still exactly that of process_line.
+// PAIRWISE and KAHAN reassociate (+) and (*), trading the exact left fold
+// for bounded rounding error; errors are reported as by process_line.
+// min_piece only decides threading: shorter lines are parsed on the
+// calling thread, and PAIRWISE and KAHAN apply to them as well.
+struct FoldOptions
+{
+    Reduction reduction = Reduction::LEFT;
+    unsigned threads = 1;            // 0 - one per hardware thread
+    std::size_t min_piece = 1 << 16; // characters of arguments per thread
+};
+
+double process_line(double current, std::string_view line, Sink & sink, const FoldOptions & options);
+
+// Processes every line of the buffer as process_line would, the last line
+// may lack a trailing '\n'. Returns the final register value.
+double process_stream(double current, std::string_view buffer, Sink & sink, const FoldOptions & options = FoldOptions());
+
+// Lines compiled once and then evaluated from any register value, giving
+// the same final value and error reports as process_line called line by
+// line. Intermediate results are not reported.
+class Program
+{
+public:
+    // Lines are split as in process_stream
+    explicit Program(std::string_view text);
+
+    double run(double current, Sink & sink) const;
+    // Reports errors to std::cerr, as process_line does
+    double run(double current) const;
+    // Runs the program on every register of the column independently.
+    // Lanes are processed in blocks by vectorised kernels, and long columns
+    // are split across threads (0 - one per hardware thread).
+    // Errors that are the same for every lane (text errors and anything
+    // after a SET) are not reported. A lane whose SQRT fails keeps its
+    // value, as in run(), and gets a non-zero flag in sqrt_failed if given,
+    // also when the failure is the same for every lane.
+    void run(double * registers, std::size_t count, std::uint8_t * sqrt_failed = nullptr, unsigned threads = 0) const;
+
+    // Number of instructions left after folding
+    std::size_t size() const;
+
+private:
+    enum class Code : std::uint8_t
+    {
+        SET,
+        ADD,
+        SUB,
+        MUL,
+        DIV,
+        REM,
+        POW,
+        NEG,
+        SQRT,  // index - line
+        REPORT // index - report
+    };
+
+    struct Instruction
+    {
+        Code code;
+        std::uint32_t index;
+        double operand;
+    };
+
+    struct Report
+    {
+        Error error;
+        std::uint32_t line;
+        std::size_t position;
+        double value;
+    };
+
+    std::vector<std::string> lines;
+    std::vector<Report> reports;
+    std::vector<Instruction> code;
+
+    static double apply(Code code, double current, double operand);
+    static void apply(const Instruction & in, double * registers, std::size_t count, std::uint8_t * sqrt_failed);
+    void run_lanes(double * registers, std::size_t count, std::uint8_t * sqrt_failed) const;
+    void add_line(std::string_view line);
+    void fold();
+};
+
+} // namespace calc
 
 double process_line(double current, const std::string & line);
@@ -1,8 +1,18 @@
 #include "calc.h"
 
-#include <cctype>   // for std::isspace
-#include <cmath>    // various math functions
-#include <iostream> // for error reporting via std::cerr
+#include <algorithm>  // for std::min, std::find_if
+#include <cctype>     // for std::isspace
+#include <cmath>      // various math functions
+#include <cstdint>    // for std::uint64_t
+#include <cstdio>     // for std::snprintf
+#include <cstring>    // for std::memcpy
+#include <functional> // for std::plus, std::multiplies, std::ref
+#include <iostream>   // for error reporting via std::cerr
+#include <thread>     // for splitting columns across threads
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace {
 
@@ -48,28 +58,39 @@ struct several_op
     bool several_args;
 };
 
-several_op parse_op(const std::string & line, std::size_t & i)
+// Reading past the end gives '\0', as std::string::operator[] does at size()
+char at(const std::string_view line, const std::size_t i)
+{
+    return i < line.size() ? line[i] : '\0';
+}
+
+void report(calc::Sink & sink, const calc::Error error, const std::string_view line, const std::size_t position, const double value = 0)
+{
+    sink.error(calc::Diagnostic{error, line, position, value});
+}
+
+several_op parse_op(const std::string_view line, std::size_t & i, calc::Sink & sink)
 {
     several_op this_op;
     this_op.several_args = false;
-    const auto rollback = [&i, &line](const std::size_t n) {
+    const auto rollback = [&i, &line, &sink](const std::size_t n) {
         i -= n;
-        std::cerr << "Unknown operation " << line << std::endl;
+        report(sink, calc::Error::UNKNOWN_OPERATION, line, i);
         several_op this_op;
         this_op.op = Op::ERR;
         return this_op;
     };
-    if (line[i] == '(') {
+    if (at(line, i) == '(') {
         ++i;
-        if (line[i + 1] == ')') {
+        if (at(line, i + 1) == ')') {
             this_op.several_args = true;
         }
         else {
-            std::cerr << "Need bracket: '" << line << "'" << std::endl;
+            report(sink, calc::Error::NEED_BRACKET, line, i);
             return rollback(1);
         }
     }
-    switch (line[i++]) {
+    switch (at(line, i++)) {
     case '0':
     case '1':
     case '2':
@@ -108,11 +129,11 @@ several_op parse_op(const std::string & line, std::size_t & i)
         this_op.op = Op::POW;
         return this_op;
     case 'S':
-        switch (line[i++]) {
+        switch (at(line, i++)) {
         case 'Q':
-            switch (line[i++]) {
+            switch (at(line, i++)) {
             case 'R':
-                switch (line[i++]) {
+                switch (at(line, i++)) {
                 case 'T':
                     this_op.op = Op::SQRT;
                     return this_op;
@@ -130,7 +151,7 @@ several_op parse_op(const std::string & line, std::size_t & i)
     }
 }
 
-std::size_t skip_ws(const std::string & line, std::size_t i)
+std::size_t skip_ws(const std::string_view line, std::size_t i)
 {
     while (i < line.size() && std::isspace(line[i])) {
         ++i;
@@ -146,60 +167,97 @@ std::size_t skip_bracket(bool several_args, std::size_t & i)
     return i;
 }
 
-double parse_arg(const std::string & line, std::size_t & i, bool several_args)
+// Digits are classified and converted 8 at a time with SWAR arithmetic on a
+// 64-bit word, the first character in its lowest byte
+std::uint64_t load_word(const std::string_view line, const std::size_t i)
+{
+    char bytes[8] = {}; // zero padding is not a digit
+    std::memcpy(bytes, line.data() + i, std::min<std::size_t>(8, line.size() - i));
+    std::uint64_t word;
+    std::memcpy(&word, bytes, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+std::size_t leading_digits(const std::uint64_t word)
 {
-    double res = 0;
+    // A byte is a digit iff its high nibble is 3 and it stays 3 after adding 6.
+    // Carries of the addition only spoil bytes after the first non-digit.
+    std::uint64_t non_digits = ((word & 0xF0F0F0F0F0F0F0F0) | (((word + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ^ 0x3333333333333333;
+    if (non_digits == 0) {
+        return 8;
+    }
+#if defined(__GNUC__)
+    return __builtin_ctzll(non_digits) / 8;
+#else
+    std::size_t n = 0;
+    while ((non_digits & 0xFF) == 0) {
+        non_digits >>= 8;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+// Value of the first n (1 to 8) digits of the word
+std::uint64_t digits_value(std::uint64_t word, const std::size_t n)
+{
+    word -= 0x3030303030303030;
+    word <<= 8 * (8 - n); // the rest turn into leading zeros
+    word = word * 10 + (word >> 8);
+    word = ((word & 0x000000FF000000FF) * (100 + (1000000ULL << 32)) + ((word >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32))) >> 32;
+    return word & 0xFFFFFFFF;
+}
+
+// The mantissa has at most max_decimal_digits digits, so it and the power
+// of ten are exact doubles and the division rounds correctly
+double parse_arg(const std::string_view line, std::size_t & i, bool several_args, calc::Sink & sink)
+{
+    static const std::uint64_t int_pow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+    static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10};
+    static_assert(max_decimal_digits < sizeof(pow10) / sizeof(pow10[0]), "pow10 is too short");
+
+    std::uint64_t mantissa = 0;
     std::size_t count = 0;
+    std::size_t fraction_digits = 0;
     bool good = true;
     bool integer = true;
-    double fraction = 1;
     while (good && i < line.size() && count < max_decimal_digits) {
-        if (several_args && std::isspace(line[i])) {
-            return res;
-        }
-        switch (line[i]) {
-        case '0':
-        case '1':
-        case '2':
-        case '3':
-        case '4':
-        case '5':
-        case '6':
-        case '7':
-        case '8':
-        case '9':
-            if (integer) {
-                res *= 10;
-                res += line[i] - '0';
+        const auto word = load_word(line, i);
+        const auto n = std::min(leading_digits(word), max_decimal_digits - count);
+        if (n > 0) {
+            mantissa = mantissa * int_pow10[n] + digits_value(word, n);
+            if (!integer) {
+                fraction_digits += n;
             }
-            else {
-                fraction /= 10;
-                res += (line[i] - '0') * fraction;
-            }
-            ++i;
-            ++count;
+            i += n;
+            count += n;
+        }
+        else if (several_args && std::isspace(line[i])) {
             break;
-        case '.':
+        }
+        else if (line[i] == '.') {
             integer = false;
             ++i;
-            break;
-        default:
+        }
+        else {
             good = false;
-            break;
         }
     }
     if (!good) {
-        std::cerr << "Argument parsing error at " << i << ": '" << line.substr(i) << "'" << std::endl;
+        report(sink, calc::Error::BAD_ARGUMENT, line, i);
         return 0;
     }
     else if (i < line.size() && !several_args) {
-        std::cerr << "Argument isn't fully parsed, suffix left: '" << line.substr(i) << "'" << std::endl;
+        report(sink, calc::Error::ARGUMENT_SUFFIX, line, i);
         return 0;
     }
-    return res;
+    return static_cast<double>(mantissa) / pow10[fraction_digits];
 }
 
-double unary(const double current, const Op op)
+double unary(const double current, const Op op, const std::string_view line, const std::size_t i, calc::Sink & sink)
 {
     switch (op) {
     case Op::NEG:
@@ -209,7 +267,7 @@ double unary(const double current, const Op op)
             return std::sqrt(current);
         }
         else {
-            std::cerr << "Bad argument for SQRT: " << current << std::endl;
+            report(sink, calc::Error::BAD_SQRT, line, i, current);
             [[fallthrough]];
         }
     default:
@@ -217,7 +275,7 @@ double unary(const double current, const Op op)
     }
 }
 
-double binary(const Op op, const double left, const double right)
+double binary(const Op op, const double left, const double right, const std::string_view line, const std::size_t i, calc::Sink & sink)
 {
     switch (op) {
     case Op::SET:
@@ -233,7 +291,7 @@ double binary(const Op op, const double left, const double right)
             return left / right;
         }
         else {
-            std::cerr << "Bad right argument for division: " << right << std::endl;
+            report(sink, calc::Error::BAD_DIVISION, line, i, right);
             return left;
         }
     case Op::REM:
@@ -241,7 +299,7 @@ double binary(const Op op, const double left, const double right)
             return std::fmod(left, right);
         }
         else {
-            std::cerr << "Bad right argument for remainder: " << right << std::endl;
+            report(sink, calc::Error::BAD_REMAINDER, line, i, right);
             return left;
         }
     case Op::POW:
@@ -251,43 +309,817 @@ double binary(const Op op, const double left, const double right)
     }
 }
 
-} // anonymous namespace
-
-double process_line(const double current, const std::string & line)
+// Parses the line and reports its errors, calling on_arg(op, arg, i) for
+// every argument of a binary operation in order. Returns the operation,
+// or Op::ERR if the line must leave the register unchanged.
+template <class OnArg>
+Op parse_line(const std::string_view line, calc::Sink & sink, OnArg && on_arg)
 {
     std::size_t i = 0;
     bool error = false;
-    double this_number = current;
-    const auto this_op = parse_op(line, i);
+    const auto this_op = parse_op(line, i, sink);
     switch (arity(this_op.op)) {
     case 2: {
         do {
             i = skip_bracket(this_op.several_args, i);
             i = skip_ws(line, i);
             const auto old_i = i;
-            const auto arg = parse_arg(line, i, this_op.several_args);
+            const auto arg = parse_arg(line, i, this_op.several_args, sink);
             if (i == old_i) {
-                std::cerr << "No argument for a binary operation" << std::endl;
+                report(sink, calc::Error::NO_ARGUMENT, line, i);
                 break;
             }
             else if ((this_op.op == Op::REM || this_op.op == Op::DIV) && arg == 0) {
                 error = true;
             }
-            this_number = binary(this_op.op, this_number, arg);
+            on_arg(this_op.op, arg, i);
         } while (i < line.size() && this_op.several_args);
         if (i < line.size() || error) {
-            return current;
+            return Op::ERR;
         }
-        return this_number;
+        return this_op.op;
     }
     case 1: {
         if (i < line.size()) {
-            std::cerr << "Unexpected suffix for a unary operation: '" << line.substr(i) << "'" << std::endl;
+            report(sink, calc::Error::UNARY_SUFFIX, line, i);
             break;
         }
-        return unary(current, this_op.op);
+        return this_op.op;
     }
     default: break;
     }
+    return Op::ERR;
+}
+
+double evaluate(const double current, const std::string_view line, calc::Sink & sink)
+{
+    double this_number = current;
+    const auto op = parse_line(line, sink, [&](const Op bin_op, const double arg, const std::size_t i) {
+        this_number = binary(bin_op, this_number, arg, line, i, sink);
+    });
+    switch (arity(op)) {
+    case 2: return this_number;
+    case 1: return unary(current, op, line, line.size(), sink);
+    default: return current;
+    }
+}
+
+// Asked once: glibc reads sysfs on every call
+unsigned hardware_threads()
+{
+    static const unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    return threads;
+}
+
+// Folds with options: the argument list is cut where the sequential parser
+// is bound to start an argument (a non-space after a space, as arguments
+// never span whitespace), so every piece parses as it would in parse_line.
+
+class Recorder : public calc::Sink
+{
+public:
+    std::vector<calc::Diagnostic> reports;
+
+    void result(double) override {}
+    void error(const calc::Diagnostic & diagnostic) override
+    {
+        reports.push_back(diagnostic);
+    }
+};
+
+struct FoldPiece
+{
+    std::size_t begin;
+    std::size_t end;
+    std::vector<double> args;
+    Recorder recorder;
+    std::size_t stop = 0; // where parsing ended
+    bool broken = false;  // an argument was missing, the rest of the line is not parsed
+    bool error = false;   // division by zero
+    double partial = 0;
+    double compensation = 0;
+};
+
+// The operation of a valid fold line, Op::ERR for anything else
+Op fold_op(const std::string_view line)
+{
+    if (line.size() < 3 || line[0] != '(' || line[2] != ')') {
+        return Op::ERR;
+    }
+    switch (line[1]) {
+    case '+': return Op::ADD;
+    case '-': return Op::SUB;
+    case '*': return Op::MUL;
+    case '/': return Op::DIV;
+    case '%': return Op::REM;
+    case '^': return Op::POW;
+    default: return Op::ERR;
+    }
+}
+
+std::vector<FoldPiece> split_fold(const std::string_view line, const calc::FoldOptions & options)
+{
+    unsigned threads = options.threads;
+    if (threads == 0) {
+        threads = hardware_threads();
+    }
+    const std::size_t args_size = line.size() - 2;
+    const std::size_t count = std::max<std::size_t>(1, std::min<std::size_t>(threads, args_size / std::max<std::size_t>(1, options.min_piece)));
+    std::vector<FoldPiece> pieces;
+    std::size_t begin = 2; // the first piece starts at ')'
+    for (std::size_t k = 1; k < count; ++k) {
+        std::size_t p = std::max(begin + 1, 2 + k * args_size / count);
+        while (p < line.size() && !(std::isspace(line[p - 1]) && !std::isspace(line[p]))) {
+            ++p;
+        }
+        if (p >= line.size()) {
+            break;
+        }
+        pieces.push_back(FoldPiece{begin, p, {}, {}});
+        begin = p;
+    }
+    pieces.push_back(FoldPiece{begin, line.size(), {}, {}});
+    return pieces;
+}
+
+// Same steps as the loop of parse_line, except that a piece after the
+// first one starts right at an argument
+void parse_piece(const std::string_view line, const Op op, FoldPiece & piece, bool skip)
+{
+    std::size_t i = piece.begin;
+    do {
+        if (skip) {
+            i = skip_bracket(true, i);
+            i = skip_ws(line, i);
+            if (i >= piece.end && piece.end < line.size()) {
+                break;
+            }
+        }
+        skip = true;
+        const auto old_i = i;
+        const auto arg = parse_arg(line, i, true, piece.recorder);
+        if (i == old_i) {
+            report(piece.recorder, calc::Error::NO_ARGUMENT, line, i);
+            piece.broken = true;
+            break;
+        }
+        else if ((op == Op::REM || op == Op::DIV) && arg == 0) {
+            piece.error = true;
+            binary(op, 0, arg, line, i, piece.recorder); // reports the division by zero
+        }
+        piece.args.push_back(arg);
+    } while (i < line.size());
+    piece.stop = i;
+}
+
+// Balanced tree over blocks reduced in 4 independent lanes
+template <class Combine>
+double pairwise(const double * x, const std::size_t n, const double identity, Combine combine)
+{
+    const std::size_t block = 128;
+    if (n > block) {
+        const std::size_t half = n / 2;
+        return combine(pairwise(x, half, identity, combine), pairwise(x + half, n - half, identity, combine));
+    }
+    double lanes[4] = {identity, identity, identity, identity};
+    std::size_t j = 0;
+    for (; j + 4 <= n; j += 4) {
+        for (std::size_t l = 0; l < 4; ++l) {
+            lanes[l] = combine(lanes[l], x[j + l]);
+        }
+    }
+    for (; j < n; ++j) {
+        lanes[0] = combine(lanes[0], x[j]);
+    }
+    return combine(combine(lanes[0], lanes[1]), combine(lanes[2], lanes[3]));
+}
+
+// Neumaier's variant of Kahan summation
+void compensated_add(double & sum, double & compensation, const double x)
+{
+    const double t = sum + x;
+    if (std::abs(sum) >= std::abs(x)) {
+        compensation += (sum - t) + x;
+    }
+    else {
+        compensation += (x - t) + sum;
+    }
+    sum = t;
+}
+
+void reduce_piece(const Op op, FoldPiece & piece, const calc::Reduction reduction)
+{
+    if (op == Op::ADD && reduction == calc::Reduction::KAHAN) {
+        for (const double arg : piece.args) {
+            compensated_add(piece.partial, piece.compensation, arg);
+        }
+    }
+    else if (op == Op::ADD) {
+        piece.partial = pairwise(piece.args.data(), piece.args.size(), 0.0, std::plus<double>());
+    }
+    else if (op == Op::MUL) {
+        piece.partial = pairwise(piece.args.data(), piece.args.size(), 1.0, std::multiplies<double>());
+    }
+}
+
+double fold_pieces(const double current, const std::string_view line, const Op op, std::vector<FoldPiece> & pieces, calc::Sink & sink, calc::Reduction reduction)
+{
+    if (op != Op::ADD && op != Op::MUL) {
+        reduction = calc::Reduction::LEFT;
+    }
+    const auto work = [&line, op, reduction](FoldPiece & piece, const bool first) {
+        parse_piece(line, op, piece, first);
+        if (reduction != calc::Reduction::LEFT) {
+            reduce_piece(op, piece, reduction);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (std::size_t k = 1; k < pieces.size(); ++k) {
+        workers.emplace_back(work, std::ref(pieces[k]), false);
+    }
+    work(pieces[0], true);
+    for (auto & worker : workers) {
+        worker.join();
+    }
+
+    std::size_t i = line.size();
+    bool error = false;
+    std::size_t used = 0;
+    while (used < pieces.size()) {
+        const auto & piece = pieces[used++];
+        for (const auto & diagnostic : piece.recorder.reports) {
+            sink.error(diagnostic);
+        }
+        error = error || piece.error;
+        i = piece.stop;
+        if (piece.broken) {
+            break;
+        }
+    }
+    if (i < line.size() || error) {
+        return current;
+    }
+
+    switch (reduction) {
+    case calc::Reduction::LEFT: {
+        double this_number = current;
+        for (std::size_t k = 0; k < used; ++k) {
+            for (const double arg : pieces[k].args) {
+                this_number = binary(op, this_number, arg, line, i, sink);
+            }
+        }
+        return this_number;
+    }
+    case calc::Reduction::KAHAN:
+        if (op == Op::ADD) {
+            double sum = current;
+            double compensation = 0;
+            for (std::size_t k = 0; k < used; ++k) {
+                compensated_add(sum, compensation, pieces[k].partial);
+                compensation += pieces[k].compensation;
+            }
+            // infinities turn the compensation into NaN
+            return std::isfinite(sum + compensation) ? sum + compensation : sum;
+        }
+        [[fallthrough]];
+    case calc::Reduction::PAIRWISE: {
+        std::vector<double> partials;
+        for (std::size_t k = 0; k < used; ++k) {
+            partials.push_back(pieces[k].partial);
+        }
+        if (op == Op::ADD) {
+            return current + pairwise(partials.data(), partials.size(), 0.0, std::plus<double>());
+        }
+        return current * pairwise(partials.data(), partials.size(), 1.0, std::multiplies<double>());
+    }
+    }
     return current;
 }
+
+// A (+) or (*) fold reduced on the calling thread, with the same grouping
+// fold_pieces gives a single piece. These folds report nothing while the
+// arguments are applied, so the arguments are gathered and reduced after
+// parse_line accepts the line.
+double reduce_line(const double current, const std::string_view line, const calc::Reduction reduction, calc::Sink & sink)
+{
+    thread_local std::vector<double> args;
+    args.clear();
+    double sum = 0;
+    double compensation = 0;
+    const auto op = parse_line(line, sink, [&](const Op bin_op, const double arg, std::size_t) {
+        if (bin_op == Op::ADD && reduction == calc::Reduction::KAHAN) {
+            compensated_add(sum, compensation, arg);
+        }
+        else {
+            args.push_back(arg);
+        }
+    });
+    switch (op) {
+    case Op::ADD:
+        if (reduction == calc::Reduction::KAHAN) {
+            double total = current;
+            double total_compensation = 0;
+            compensated_add(total, total_compensation, sum);
+            total_compensation += compensation;
+            return std::isfinite(total + total_compensation) ? total + total_compensation : total;
+        }
+        return current + pairwise(args.data(), args.size(), 0.0, std::plus<double>());
+    case Op::MUL:
+        return current * pairwise(args.data(), args.size(), 1.0, std::multiplies<double>());
+    default:
+        return current;
+    }
+}
+
+// Reports errors to std::cerr right away, as process_line always did
+class ErrorStream : public calc::Sink
+{
+public:
+    void result(double) override {}
+    void error(const calc::Diagnostic & diagnostic) override
+    {
+        std::cerr << calc::describe(diagnostic) << std::endl;
+    }
+};
+
+void append(std::string & out, const double value)
+{
+    // "%g" formats as std::ostream does by default
+    char buffer[32];
+    const int n = std::snprintf(buffer, sizeof(buffer), "%g", value);
+    out.append(buffer, n);
+}
+
+
+// Appends the message describe() returns
+void append(std::string & message, const calc::Diagnostic & diagnostic)
+{
+    using calc::Error;
+    const auto suffix = diagnostic.line.substr(std::min(diagnostic.position, diagnostic.line.size()));
+    switch (diagnostic.error) {
+    case Error::UNKNOWN_OPERATION:
+        message += "Unknown operation ";
+        message += diagnostic.line;
+        break;
+    case Error::NEED_BRACKET:
+        message += "Need bracket: '";
+        message += diagnostic.line;
+        message += "'";
+        break;
+    case Error::BAD_ARGUMENT:
+        message += "Argument parsing error at ";
+        message += std::to_string(diagnostic.position);
+        message += ": '";
+        message += suffix;
+        message += "'";
+        break;
+    case Error::ARGUMENT_SUFFIX:
+        message += "Argument isn't fully parsed, suffix left: '";
+        message += suffix;
+        message += "'";
+        break;
+    case Error::NO_ARGUMENT:
+        message += "No argument for a binary operation";
+        break;
+    case Error::UNARY_SUFFIX:
+        message += "Unexpected suffix for a unary operation: '";
+        message += suffix;
+        message += "'";
+        break;
+    case Error::BAD_SQRT:
+        message += "Bad argument for SQRT: ";
+        append(message, diagnostic.value);
+        break;
+    case Error::BAD_DIVISION:
+        message += "Bad right argument for division: ";
+        append(message, diagnostic.value);
+        break;
+    case Error::BAD_REMAINDER:
+        message += "Bad right argument for remainder: ";
+        append(message, diagnostic.value);
+        break;
+    }
+}
+
+} // anonymous namespace
+
+namespace calc {
+
+std::string describe(const Diagnostic & diagnostic)
+{
+    std::string message;
+    append(message, diagnostic);
+    return message;
+}
+
+BufferedSink::BufferedSink(std::ostream & out_stream, std::ostream & err_stream, const std::size_t buffer_capacity, const bool ordered)
+    : out(out_stream)
+    , err(err_stream)
+    , capacity(buffer_capacity)
+    , keep_order(ordered)
+{
+    out_buffer.reserve(capacity + 32);
+}
+
+void BufferedSink::result(const double value)
+{
+    if (keep_order) {
+        write(err, err_buffer);
+    }
+    append(out_buffer, value);
+    out_buffer += '\n';
+    if (out_buffer.size() >= capacity) {
+        write(out, out_buffer);
+    }
+}
+
+void BufferedSink::error(const Diagnostic & diagnostic)
+{
+    if (keep_order) {
+        write(out, out_buffer);
+    }
+    append(err_buffer, diagnostic);
+    err_buffer += '\n';
+    if (err_buffer.size() >= capacity) {
+        write(err, err_buffer);
+    }
+}
+
+void BufferedSink::flush()
+{
+    write(out, out_buffer);
+    write(err, err_buffer);
+}
+
+void BufferedSink::write(std::ostream & stream, std::string & buffer)
+{
+    if (buffer.empty()) {
+        return;
+    }
+    stream.write(buffer.data(), buffer.size());
+    stream.flush();
+    buffer.clear();
+}
+
+BufferedSink::~BufferedSink()
+{
+    flush();
+}
+
+double process_line(const double current, const std::string_view line, Sink & sink, const FoldOptions & options)
+{
+    const auto op = fold_op(line);
+    const bool reassociate = options.reduction != Reduction::LEFT && (op == Op::ADD || op == Op::MUL);
+    const auto sequential = [&] {
+        return reassociate ? reduce_line(current, line, options.reduction, sink) : evaluate(current, line, sink);
+    };
+    // min_piece decides only how many threads parse the line
+    if (op == Op::ERR || line.size() - 2 < options.min_piece) {
+        return sequential();
+    }
+    auto pieces = split_fold(line, options);
+    if (pieces.size() == 1) {
+        return sequential();
+    }
+    return fold_pieces(current, line, op, pieces, sink, options.reduction);
+}
+
+double process_stream(double current, const std::string_view buffer, Sink & sink, const FoldOptions & options)
+{
+    std::size_t begin = 0;
+    while (begin < buffer.size()) {
+        auto end = buffer.find('\n', begin);
+        if (end == std::string_view::npos) {
+            end = buffer.size();
+        }
+        current = process_line(current, buffer.substr(begin, end - begin), sink, options);
+        sink.result(current);
+        begin = end + 1;
+    }
+    return current;
+}
+
+Program::Program(const std::string_view text)
+{
+    std::size_t begin = 0;
+    while (begin < text.size()) {
+        auto end = text.find('\n', begin);
+        if (end == std::string_view::npos) {
+            end = text.size();
+        }
+        add_line(text.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    fold();
+}
+
+void Program::add_line(const std::string_view line)
+{
+    const auto index = static_cast<std::uint32_t>(lines.size());
+    lines.emplace_back(line);
+
+    // Every error but the SQRT one depends only on the text, so it is
+    // recorded once and replayed on each run
+    class Recorder : public Sink
+    {
+    public:
+        Recorder(Program & p, const std::uint32_t i)
+            : program(p)
+            , line_index(i)
+        {
+        }
+        void result(double) override {}
+        void error(const Diagnostic & diagnostic) override
+        {
+            program.code.push_back({Code::REPORT, static_cast<std::uint32_t>(program.reports.size()), 0});
+            program.reports.push_back({diagnostic.error, line_index, diagnostic.position, diagnostic.value});
+        }
+
+    private:
+        Program & program;
+        std::uint32_t line_index;
+    };
+
+    const auto to_code = [](const Op op) {
+        switch (op) {
+        case Op::ADD: return Code::ADD;
+        case Op::SUB: return Code::SUB;
+        case Op::MUL: return Code::MUL;
+        case Op::DIV: return Code::DIV;
+        case Op::REM: return Code::REM;
+        case Op::POW: return Code::POW;
+        case Op::NEG: return Code::NEG;
+        case Op::SQRT: return Code::SQRT;
+        default: return Code::SET;
+        }
+    };
+
+    Recorder recorder(*this, index);
+    std::vector<Instruction> steps;
+    const auto op = parse_line(line, recorder, [&](const Op bin_op, const double arg, const std::size_t i) {
+        // binary() reports only division by zero, whatever the left operand is
+        binary(bin_op, 0, arg, line, i, recorder);
+        steps.push_back({to_code(bin_op), index, arg});
+    });
+    switch (arity(op)) {
+    case 2:
+        code.insert(code.end(), steps.begin(), steps.end());
+        break;
+    case 1:
+        code.push_back({to_code(op), index, 0});
+        break;
+    default: break;
+    }
+}
+
+// Only rewrites that give bit-identical results: runs of additions are
+// not summed up front, as that would change rounding
+void Program::fold()
+{
+    // Operations that never change the register
+    std::vector<Instruction> folded;
+    for (const auto & in : code) {
+        if ((in.code == Code::MUL || in.code == Code::DIV) && in.operand == 1) {
+            continue;
+        }
+        if (in.code == Code::SUB && in.operand == 0 && !std::signbit(in.operand)) {
+            continue;
+        }
+        if (in.code == Code::NEG && !folded.empty() && folded.back().code == Code::NEG) {
+            folded.pop_back();
+            continue;
+        }
+        folded.push_back(in);
+    }
+
+    // Arithmetic right before SET is dead, unless a SQRT needs its result
+    // to decide whether to report an error
+    std::vector<bool> keep(folded.size(), true);
+    bool dead = false;
+    for (std::size_t i = folded.size(); i-- > 0;) {
+        switch (folded[i].code) {
+        case Code::REPORT: break;
+        case Code::SQRT: dead = false; break;
+        case Code::SET:
+            keep[i] = !dead;
+            dead = true;
+            break;
+        default: keep[i] = !dead; break;
+        }
+    }
+    code.clear();
+    for (std::size_t i = 0; i < folded.size(); ++i) {
+        if (keep[i]) {
+            code.push_back(folded[i]);
+        }
+    }
+
+    // From the first SET on the register does not depend on the initial
+    // value, so everything after it is computed now
+    const auto first_set = std::find_if(code.begin(), code.end(), [](const Instruction & in) {
+        return in.code == Code::SET;
+    });
+    if (first_set == code.end()) {
+        return;
+    }
+    std::vector<Instruction> tail;
+    double value = 0;
+    for (auto it = first_set; it != code.end(); ++it) {
+        switch (it->code) {
+        case Code::REPORT:
+            tail.push_back(*it);
+            break;
+        case Code::SQRT:
+            if (value > 0) {
+                value = std::sqrt(value);
+            }
+            else {
+                tail.push_back({Code::REPORT, static_cast<std::uint32_t>(reports.size()), 0});
+                reports.push_back({Error::BAD_SQRT, it->index, lines[it->index].size(), value});
+            }
+            break;
+        default:
+            value = apply(it->code, value, it->operand);
+            break;
+        }
+    }
+    tail.push_back({Code::SET, 0, value});
+    code.erase(first_set, code.end());
+    code.insert(code.end(), tail.begin(), tail.end());
+}
+
+double Program::apply(const Code code, const double current, const double operand)
+{
+    switch (code) {
+    case Code::SET: return operand;
+    case Code::ADD: return current + operand;
+    case Code::SUB: return current - operand;
+    case Code::MUL: return current * operand;
+    case Code::DIV: return current / operand;
+    case Code::REM: return std::fmod(current, operand);
+    case Code::POW: return std::pow(current, operand);
+    case Code::NEG: return -current;
+    default: return current;
+    }
+}
+
+double Program::run(double current, Sink & sink) const
+{
+    for (const auto & in : code) {
+        switch (in.code) {
+        case Code::SQRT:
+            if (current > 0) {
+                current = std::sqrt(current);
+            }
+            else {
+                const auto & line = lines[in.index];
+                sink.error(Diagnostic{Error::BAD_SQRT, line, line.size(), current});
+            }
+            break;
+        case Code::REPORT: {
+            const auto & report = reports[in.index];
+            sink.error(Diagnostic{report.error, lines[report.line], report.position, report.value});
+            break;
+        }
+        default:
+            current = apply(in.code, current, in.operand);
+            break;
+        }
+    }
+    return current;
+}
+
+double Program::run(const double current) const
+{
+    ErrorStream sink;
+    return run(current, sink);
+}
+
+void Program::run(double * registers, const std::size_t count, std::uint8_t * sqrt_failed, unsigned threads) const
+{
+    const std::size_t min_lanes_per_thread = 1 << 16;
+    if (threads == 0) {
+        threads = hardware_threads();
+    }
+    threads = static_cast<unsigned>(std::min<std::size_t>(threads, std::max<std::size_t>(1, count / min_lanes_per_thread)));
+    if (threads == 1) {
+        run_lanes(registers, count, sqrt_failed);
+        return;
+    }
+    const std::size_t chunk = (count + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    for (std::size_t begin = 0; begin < count; begin += chunk) {
+        const std::size_t n = std::min(chunk, count - begin);
+        workers.emplace_back([this, registers, sqrt_failed, begin, n] {
+            run_lanes(registers + begin, n, sqrt_failed == nullptr ? nullptr : sqrt_failed + begin);
+        });
+    }
+    for (auto & worker : workers) {
+        worker.join();
+    }
+}
+
+// Blocks small enough to stay in L1 while every instruction runs over them
+void Program::run_lanes(double * registers, const std::size_t count, std::uint8_t * sqrt_failed) const
+{
+    const std::size_t block = 512;
+    if (sqrt_failed != nullptr) {
+        std::fill(sqrt_failed, sqrt_failed + count, 0);
+    }
+    for (std::size_t begin = 0; begin < count; begin += block) {
+        const std::size_t n = std::min(block, count - begin);
+        for (const auto & in : code) {
+            if (in.code == Code::REPORT && sqrt_failed != nullptr && reports[in.index].error == Error::BAD_SQRT) {
+                // a SQRT folded after a SET fails for every lane
+                std::fill(sqrt_failed + begin, sqrt_failed + begin + n, 1);
+            }
+            apply(in, registers + begin, n, sqrt_failed == nullptr ? nullptr : sqrt_failed + begin);
+        }
+    }
+}
+
+// Plain loops over the lanes, vectorised by the compiler; SQRT needs a
+// per-lane mask, so it is written with SSE2 where available
+void Program::apply(const Instruction & in, double * r, const std::size_t count, std::uint8_t * sqrt_failed)
+{
+    const double operand = in.operand;
+    switch (in.code) {
+    case Code::SET:
+        std::fill(r, r + count, operand);
+        break;
+    case Code::ADD:
+        for (std::size_t j = 0; j < count; ++j) {
+            r[j] += operand;
+        }
+        break;
+    case Code::SUB:
+        for (std::size_t j = 0; j < count; ++j) {
+            r[j] -= operand;
+        }
+        break;
+    case Code::MUL:
+        for (std::size_t j = 0; j < count; ++j) {
+            r[j] *= operand;
+        }
+        break;
+    case Code::DIV:
+        for (std::size_t j = 0; j < count; ++j) {
+            r[j] /= operand;
+        }
+        break;
+    case Code::REM:
+        for (std::size_t j = 0; j < count; ++j) {
+            r[j] = std::fmod(r[j], operand);
+        }
+        break;
+    case Code::POW:
+        for (std::size_t j = 0; j < count; ++j) {
+            r[j] = std::pow(r[j], operand);
+        }
+        break;
+    case Code::NEG:
+        for (std::size_t j = 0; j < count; ++j) {
+            r[j] = -r[j];
+        }
+        break;
+    case Code::SQRT: {
+        std::size_t j = 0;
+#if defined(__SSE2__)
+        const __m128d zero = _mm_setzero_pd();
+        for (; j + 2 <= count; j += 2) {
+            const __m128d x = _mm_loadu_pd(r + j);
+            const __m128d positive = _mm_cmpgt_pd(x, zero); // false for NaN, as in unary()
+            _mm_storeu_pd(r + j, _mm_or_pd(_mm_and_pd(positive, _mm_sqrt_pd(x)), _mm_andnot_pd(positive, x)));
+            if (sqrt_failed != nullptr) {
+                const int failed = ~_mm_movemask_pd(positive);
+                sqrt_failed[j] |= failed & 1;
+                sqrt_failed[j + 1] |= (failed >> 1) & 1;
+            }
+        }
+#endif
+        for (; j < count; ++j) {
+            if (r[j] > 0) {
+                r[j] = std::sqrt(r[j]);
+            }
+            else if (sqrt_failed != nullptr) {
+                sqrt_failed[j] = 1;
+            }
+        }
+        break;
+    }
+    case Code::REPORT: break;
+    }
+}
+
+std::size_t Program::size() const
+{
+    return code.size();
+}
+
+} // namespace calc
+
+double process_line(const double current, const std::string & line)
+{
+    ErrorStream sink;
+    return evaluate(current, line, sink);
+}
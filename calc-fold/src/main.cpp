@@ -1,13 +1,58 @@
 #include "calc.h"
 
+#include <algorithm>
+#include <cerrno>
 #include <iostream>
-#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Results and errors must interleave exactly only when they end up in one file
+bool same_file(const int left, const int right)
+{
+    struct stat a;
+    struct stat b;
+    if (fstat(left, &a) != 0 || fstat(right, &b) != 0) {
+        return true;
+    }
+    return a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+}
+
+} // anonymous namespace
 
 int main()
 {
+    std::ios::sync_with_stdio(false);
+    calc::BufferedSink sink(std::cout, std::cerr, 1 << 16, same_file(STDOUT_FILENO, STDERR_FILENO));
     double current = 0;
-    for (std::string line; std::getline(std::cin, line);) {
-        current = process_line(current, line);
-        std::cout << current << std::endl;
+    std::vector<char> buffer(1 << 16);
+    std::size_t filled = 0;
+    for (;;) {
+        if (filled == buffer.size()) { // a line longer than the buffer
+            buffer.resize(buffer.size() * 2);
+        }
+        // returns what is already available, so typed lines are answered at once
+        const auto got = ::read(STDIN_FILENO, buffer.data() + filled, buffer.size() - filled);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            break;
+        }
+        filled += static_cast<std::size_t>(got);
+        const std::string_view data(buffer.data(), filled);
+        const auto last = data.rfind('\n');
+        if (last == std::string_view::npos) {
+            continue;
+        }
+        current = calc::process_stream(current, data.substr(0, last + 1), sink);
+        sink.flush();
+        std::copy(buffer.begin() + last + 1, buffer.begin() + filled, buffer.begin());
+        filled -= last + 1;
     }
+    calc::process_stream(current, std::string_view(buffer.data(), filled), sink);
 }
@@ -0,0 +1,244 @@
+#include "ScapegoatTree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+// Compares ScapegoatTree across alpha values and against std::set on
+// several workloads, then reruns them with counters to show rebuild and
+// search statistics and the tail latency of inserts that rebuild.
+// Usage: trees_bench_alpha [operations]
+
+namespace {
+
+enum class Kind
+{
+    CONTAINS,
+    INSERT,
+    REMOVE
+};
+
+struct Operation
+{
+    Kind kind;
+    int key;
+};
+
+struct Workload
+{
+    std::string name;
+    std::vector<Operation> ops;
+};
+
+const double alphas[] = {0.55, 0.6, 0.65, 0.7, 0.75, 0.8, 0.85, 0.9};
+
+Workload sequential(int n)
+{
+    Workload w{"sequential", {}};
+    for (int i = 0; i < n; ++i) {
+        w.ops.push_back({Kind::INSERT, i});
+    }
+    for (int i = 0; i < n; ++i) {
+        w.ops.push_back({Kind::CONTAINS, i});
+    }
+    return w;
+}
+
+Workload random(int n)
+{
+    Workload w{"random", {}};
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<int> keys(0, 4 * n);
+    for (int i = 0; i < n; ++i) {
+        w.ops.push_back({Kind::INSERT, keys(gen)});
+    }
+    for (int i = 0; i < n; ++i) {
+        w.ops.push_back({Kind::CONTAINS, keys(gen)});
+    }
+    return w;
+}
+
+// Lookup-heavy mix over keys with Zipf(1) popularity, hot keys scattered
+Workload zipfian(int n)
+{
+    Workload w{"zipfian", {}};
+    const int range = 1 << 16;
+    std::vector<double> weights(range);
+    for (int rank = 0; rank < range; ++rank) {
+        weights[rank] = 1.0 / (rank + 1);
+    }
+    std::discrete_distribution<int> ranks(weights.begin(), weights.end());
+    std::mt19937 gen(2);
+    std::uniform_int_distribution<int> kinds(0, 9);
+    for (int i = 0; i < 2 * n; ++i) {
+        const int key = static_cast<int>((ranks(gen) * 2654435761u) % range);
+        const int kind = kinds(gen);
+        w.ops.push_back({kind < 8 ? Kind::CONTAINS : (kind == 8 ? Kind::INSERT : Kind::REMOVE), key});
+    }
+    return w;
+}
+
+Workload delete_heavy(int n)
+{
+    Workload w{"delete-heavy", {}};
+    std::mt19937 gen(3);
+    std::vector<int> keys(n);
+    for (int i = 0; i < n; ++i) {
+        keys[i] = i;
+    }
+    std::shuffle(keys.begin(), keys.end(), gen);
+    for (const int key : keys) {
+        w.ops.push_back({Kind::INSERT, key});
+    }
+    std::shuffle(keys.begin(), keys.end(), gen);
+    std::uniform_int_distribution<int> kinds(0, 3);
+    for (const int key : keys) {
+        w.ops.push_back({kinds(gen) == 0 ? Kind::INSERT : Kind::REMOVE, key});
+    }
+    return w;
+}
+
+// std::set does not share the tree interface
+struct StdSet
+{
+    std::set<int> set;
+
+    bool contains(int value) const { return set.count(value) != 0; }
+    bool insert(int value) { return set.insert(value).second; }
+    bool remove(int value) { return set.erase(value) != 0; }
+};
+
+template <class Set>
+std::size_t run(Set & set, const Workload & w)
+{
+    std::size_t hits = 0;
+    for (const auto & op : w.ops) {
+        switch (op.kind) {
+        case Kind::CONTAINS: hits += set.contains(op.key); break;
+        case Kind::INSERT: hits += set.insert(op.key); break;
+        case Kind::REMOVE: hits += set.remove(op.key); break;
+        }
+    }
+    return hits;
+}
+
+template <class Set, class... Args>
+double ns_per_op(const Workload & w, std::size_t & hits, Args... args)
+{
+    const auto start = std::chrono::steady_clock::now();
+    {
+        Set set(args...);
+        hits += run(set, w);
+    }
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / w.ops.size();
+}
+
+// Latency of single inserts, split by whether the insert rebuilt a subtree
+struct InsertLatency
+{
+    double p50 = 0;
+    double p99 = 0;
+    double max = 0;
+    double p99_all = 0;
+    std::size_t rebuilding = 0;
+};
+
+double percentile(std::vector<double> & ns, const double p)
+{
+    if (ns.empty()) {
+        return 0;
+    }
+    const auto k = static_cast<std::size_t>(p * (ns.size() - 1));
+    std::nth_element(ns.begin(), ns.begin() + k, ns.end());
+    return ns[k];
+}
+
+template <class Tree>
+InsertLatency insert_latency(const Workload & w, const double alpha)
+{
+    Tree tree(alpha);
+    std::vector<double> all;
+    std::vector<double> rebuilding;
+    for (const auto & op : w.ops) {
+        if (op.kind != Kind::INSERT) {
+            continue;
+        }
+        const std::size_t before = tree.rebuilds();
+        const auto start = std::chrono::steady_clock::now();
+        tree.insert(op.key);
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        all.push_back(elapsed.count());
+        if (tree.rebuilds() != before) {
+            rebuilding.push_back(elapsed.count());
+        }
+    }
+    InsertLatency result;
+    result.rebuilding = rebuilding.size();
+    result.p50 = percentile(rebuilding, 0.5);
+    result.p99 = percentile(rebuilding, 0.99);
+    result.max = rebuilding.empty() ? 0 : *std::max_element(rebuilding.begin(), rebuilding.end());
+    result.p99_all = percentile(all, 0.99);
+    return result;
+}
+
+} // anonymous namespace
+
+int main(int argc, char ** argv)
+{
+    const int n = argc > 1 ? std::max(1, std::atoi(argv[1])) : 1 << 17;
+    const std::vector<Workload> workloads = {sequential(n), random(n), zipfian(n), delete_heavy(n)};
+    std::size_t hits = 0;
+
+    std::cout << "ns/op" << std::endl;
+    std::cout << std::setw(14) << "workload" << std::setw(10) << "std::set";
+    for (const double alpha : alphas) {
+        std::cout << std::setw(8) << alpha;
+    }
+    std::cout << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    for (const auto & w : workloads) {
+        std::cout << std::setw(14) << w.name << std::setw(10) << ns_per_op<StdSet>(w, hits);
+        for (const double alpha : alphas) {
+            std::cout << std::setw(8) << ns_per_op<ScapegoatTree>(w, hits, alpha);
+        }
+        std::cout << std::endl;
+    }
+
+    using CountingTree = ScapegoatSet<int, std::less<int>, std::allocator<int>, true>;
+    std::cout << std::endl
+              << std::setw(14) << "workload" << std::setw(8) << "alpha" << std::setw(10) << "rebuilds"
+              << std::setw(14) << "rebuilt nodes" << std::setw(11) << "max depth" << std::setw(10) << "avg path" << std::endl;
+    for (const auto & w : workloads) {
+        for (const double alpha : alphas) {
+            CountingTree tree(alpha);
+            hits += run(tree, w);
+            const auto stats = tree.stats();
+            std::cout << std::setw(14) << w.name << std::setw(8) << std::setprecision(2) << alpha
+                      << std::setw(10) << stats.rebuilds << std::setw(14) << stats.rebuilt_nodes
+                      << std::setw(11) << stats.max_depth << std::setw(10) << stats.average_search_path() << std::endl;
+        }
+    }
+
+    std::cout << std::endl
+              << "latency of inserts that rebuild, ns" << std::endl
+              << std::setw(14) << "workload" << std::setw(8) << "alpha" << std::setw(10) << "rebuilds"
+              << std::setw(10) << "p50" << std::setw(12) << "p99" << std::setw(12) << "max" << std::setw(14) << "p99 (all)" << std::endl;
+    for (const auto & w : {sequential(n), random(n)}) {
+        for (const double alpha : {0.6, 0.75, 0.9}) {
+            const auto latency = insert_latency<CountingTree>(w, alpha);
+            std::cout << std::setw(14) << w.name << std::setw(8) << std::setprecision(2) << alpha
+                      << std::setw(10) << latency.rebuilding << std::setprecision(0)
+                      << std::setw(10) << latency.p50 << std::setw(12) << latency.p99
+                      << std::setw(12) << latency.max << std::setw(14) << latency.p99_all << std::endl;
+        }
+    }
+    std::cerr << "checksum " << hits << std::endl;
+}
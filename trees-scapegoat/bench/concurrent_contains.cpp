@@ -0,0 +1,109 @@
+#include "ConcurrentScapegoatSet.h"
+#include "ScapegoatTree.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Read throughput of contains() with one concurrent writer doing insert/remove:
+// a ScapegoatTree behind a global mutex against ConcurrentScapegoatSet.
+// Usage: trees_bench_concurrent [max_threads] [milliseconds_per_run]
+
+namespace {
+
+const int key_range = 1 << 18;
+const int prefill = key_range / 2;
+
+struct LockedTree
+{
+    ScapegoatTree tree;
+    mutable std::mutex mutex;
+
+    bool contains(int value) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return tree.contains(value);
+    }
+    bool insert(int value)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return tree.insert(value);
+    }
+    bool remove(int value)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return tree.remove(value);
+    }
+};
+
+template <class Set>
+double reads_per_second(unsigned readers, std::chrono::milliseconds duration)
+{
+    Set set;
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> keys(0, key_range - 1);
+    for (int i = 0; i < prefill; ++i) {
+        set.insert(keys(gen));
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<unsigned long long> reads{0};
+    std::vector<std::thread> threads;
+    threads.emplace_back([&set, &stop] {
+        std::mt19937 writer_gen(7);
+        std::uniform_int_distribution<int> writer_keys(0, key_range - 1);
+        while (!stop.load(std::memory_order_relaxed)) {
+            const int key = writer_keys(writer_gen);
+            if (!set.insert(key)) {
+                set.remove(key);
+            }
+        }
+    });
+    for (unsigned t = 0; t < readers; ++t) {
+        threads.emplace_back([&set, &stop, &reads, t] {
+            std::mt19937 reader_gen(100 + t);
+            std::uniform_int_distribution<int> reader_keys(0, key_range - 1);
+            unsigned long long count = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                set.contains(reader_keys(reader_gen));
+                ++count;
+            }
+            reads += count;
+        });
+    }
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (auto & thread : threads) {
+        thread.join();
+    }
+    return reads.load() / std::chrono::duration<double>(duration).count();
+}
+
+} // anonymous namespace
+
+int main(int argc, char ** argv)
+{
+    unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::chrono::milliseconds duration(500);
+    if (argc > 1) {
+        max_threads = std::max(1, std::atoi(argv[1]));
+    }
+    if (argc > 2) {
+        duration = std::chrono::milliseconds(std::atoi(argv[2]));
+    }
+
+    std::cout << "readers  mutex Mreads/s  snapshot Mreads/s" << std::endl;
+    for (unsigned readers = 1; readers <= max_threads; readers *= 2) {
+        const double locked = reads_per_second<LockedTree>(readers, duration);
+        const double snapshot = reads_per_second<ConcurrentScapegoatSet<int>>(readers, duration);
+        std::cout << std::setw(7) << readers
+                  << std::setw(18) << std::fixed << std::setprecision(2) << locked / 1e6
+                  << std::setw(19) << snapshot / 1e6 << std::endl;
+    }
+}
@@ -0,0 +1,406 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+// Counters of a tree built with CollectStats, they stay zero otherwise.
+// max_depth is computed on request and is available for every tree.
+struct ScapegoatStats
+{
+    std::size_t rebuilds = 0;
+    std::size_t rebuilt_nodes = 0;
+    std::size_t max_depth = 0;
+    std::size_t searches = 0;
+    std::size_t search_path = 0; // nodes visited by all searches
+
+    double average_search_path() const
+    {
+        return searches == 0 ? 0 : static_cast<double>(search_path) / searches;
+    }
+};
+
+namespace scapegoat_detail {
+
+// Rebuild steps shared by the scapegoat trees, for any node with
+// left, right and an int size
+
+// Builds a perfectly balanced tree of the first `count` nodes of the vine
+// and advances the vine past them
+template <class Node>
+Node * build_balanced_tree(Node *& vine, const std::size_t count)
+{
+    if (count == 0) {
+        return nullptr;
+    }
+    Node * left = build_balanced_tree(vine, count / 2);
+    Node * v = vine;
+    vine = vine->right;
+    v->left = left;
+    v->right = build_balanced_tree(vine, count - count / 2 - 1);
+    v->size = count;
+    return v;
+}
+
+// Turns the subtree into a vine (a list linked through right pointers in
+// ascending order) by right rotations, without any extra memory.
+template <class Node>
+Node * flatten(Node * node)
+{
+    Node * head = nullptr;
+    Node * tail = nullptr;
+    while (node != nullptr) {
+        if (node->left != nullptr) {
+            Node * tmp = node->left;
+            node->left = tmp->right;
+            tmp->right = node;
+            node = tmp;
+            if (tail != nullptr) {
+                tail->right = node;
+            }
+        }
+        else {
+            if (head == nullptr) {
+                head = node;
+            }
+            tail = node;
+            node = node->right;
+        }
+    }
+    return head;
+}
+
+} // namespace scapegoat_detail
+
+// Scapegoat tree core shared by ScapegoatSet and ScapegoatMap.
+// Nodes hold Value, ordered by the key KeyOfValue extracts from it.
+// Values are never moved after construction: rebuilds only relink nodes.
+// With CollectStats every search updates counters, so even const calls
+// must not run concurrently.
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, bool CollectStats = false>
+class BasicScapegoatTree
+{
+public:
+    using key_type = Key;
+    using value_type = Value;
+    using key_compare = Compare;
+    using allocator_type = Alloc;
+
+    BasicScapegoatTree() = default;
+    BasicScapegoatTree(double alpha, const Compare & compare = Compare(), const Alloc & alloc = Alloc())
+        : tree_alpha(alpha)
+        , comp(compare)
+        , node_alloc(alloc)
+    {
+        if (alpha < 0.5 || alpha > 1) {
+            throw std::invalid_argument("Invalid argument, alpha belongs to 0.5 to 1");
+        }
+    }
+
+    BasicScapegoatTree(const BasicScapegoatTree &) = delete;
+    BasicScapegoatTree & operator=(const BasicScapegoatTree &) = delete;
+
+    BasicScapegoatTree(BasicScapegoatTree && other) noexcept
+        : root(std::exchange(other.root, nullptr))
+        , tree_alpha(other.tree_alpha)
+        , tree_size(std::exchange(other.tree_size, 0))
+        , comp(std::move(other.comp))
+        , node_alloc(std::move(other.node_alloc))
+        , counters(std::exchange(other.counters, ScapegoatStats()))
+    {
+    }
+
+    BasicScapegoatTree & operator=(BasicScapegoatTree && other) noexcept
+    {
+        std::swap(root, other.root);
+        std::swap(tree_alpha, other.tree_alpha);
+        std::swap(tree_size, other.tree_size);
+        std::swap(comp, other.comp);
+        std::swap(node_alloc, other.node_alloc);
+        std::swap(counters, other.counters);
+        return *this;
+    }
+
+    bool contains(const Key & key) const
+    {
+        return find_node(key) != nullptr;
+    }
+
+    // Constructs the value in place, it is destroyed if its key is already present
+    template <class... Args>
+    bool emplace(Args &&... args)
+    {
+        Node * node = create_node(std::forward<Args>(args)...);
+        if (contains(KeyOfValue()(node->value))) {
+            destroy_node(node);
+            return false;
+        }
+        link(node);
+        return true;
+    }
+
+    bool remove(const Key & key)
+    {
+        if (!contains(key)) {
+            return false;
+        }
+        root = remove(root, key);
+        --tree_size;
+        root = check_rebuild(root, key);
+        return true;
+    }
+
+    std::size_t size() const
+    {
+        return tree_size;
+    }
+
+    bool empty() const
+    {
+        return tree_size == 0;
+    }
+
+    ScapegoatStats stats() const
+    {
+        ScapegoatStats result = counters;
+        result.max_depth = depth(root);
+        return result;
+    }
+
+    // The rebuild counter alone, without the walk stats() does for max_depth
+    std::size_t rebuilds() const
+    {
+        return counters.rebuilds;
+    }
+
+    void reset_stats()
+    {
+        counters = ScapegoatStats();
+    }
+
+    // Visits values in ascending key order
+    template <class F>
+    void for_each(F && f) const
+    {
+        for_each(root, f);
+    }
+
+    ~BasicScapegoatTree()
+    {
+        clear(root);
+    }
+
+protected:
+    struct Node
+    {
+        Node * left = nullptr;
+        Node * right = nullptr;
+        int size = 1;
+        Value value;
+
+        template <class... Args>
+        Node(std::in_place_t, Args &&... args)
+            : value(std::forward<Args>(args)...)
+        {
+        }
+    };
+
+    Node * find_node(const Key & key) const
+    {
+        Node * node = root;
+        if constexpr (CollectStats) {
+            ++counters.searches;
+        }
+        while (node != nullptr) {
+            if constexpr (CollectStats) {
+                ++counters.search_path;
+            }
+            if (comp(key, key_of(node))) {
+                node = node->left;
+            }
+            else if (comp(key_of(node), key)) {
+                node = node->right;
+            }
+            else {
+                return node;
+            }
+        }
+        return nullptr;
+    }
+
+    // Looks the key up first and constructs the value only if it is absent,
+    // so args may move from the key
+    template <class... Args>
+    bool insert_unique(const Key & key, Args &&... args)
+    {
+        if (contains(key)) {
+            return false;
+        }
+        link(create_node(std::forward<Args>(args)...));
+        return true;
+    }
+
+private:
+    using NodeAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<Node>;
+    using NodeTraits = std::allocator_traits<NodeAlloc>;
+
+    Node * root = nullptr;
+    double tree_alpha = 0.75;
+    std::size_t tree_size = 0;
+    Compare comp;
+    NodeAlloc node_alloc;
+    mutable ScapegoatStats counters;
+
+    static const Key & key_of(const Node * node)
+    {
+        return KeyOfValue()(node->value);
+    }
+
+    bool equal(const Key & left, const Key & right) const
+    {
+        return !comp(left, right) && !comp(right, left);
+    }
+
+    template <class... Args>
+    Node * create_node(Args &&... args)
+    {
+        Node * node = NodeTraits::allocate(node_alloc, 1);
+        try {
+            NodeTraits::construct(node_alloc, node, std::in_place, std::forward<Args>(args)...);
+        }
+        catch (...) {
+            NodeTraits::deallocate(node_alloc, node, 1);
+            throw;
+        }
+        return node;
+    }
+
+    void destroy_node(Node * node)
+    {
+        NodeTraits::destroy(node_alloc, node);
+        NodeTraits::deallocate(node_alloc, node, 1);
+    }
+
+    void clear(Node * node)
+    {
+        node = scapegoat_detail::flatten(node);
+        while (node != nullptr) {
+            Node * next = node->right;
+            destroy_node(node);
+            node = next;
+        }
+    }
+
+    void link(Node * node)
+    {
+        root = insert(root, node);
+        ++tree_size;
+        root = check_rebuild(root, key_of(node));
+    }
+
+    Node * insert(Node * node, Node * leaf) const
+    {
+        if (node == nullptr) {
+            return leaf;
+        }
+        ++node->size;
+        if (comp(key_of(leaf), key_of(node))) {
+            node->left = insert(node->left, leaf);
+        }
+        else {
+            node->right = insert(node->right, leaf);
+        }
+        return node;
+    }
+
+    Node * remove(Node * node, const Key & key)
+    {
+        --node->size;
+        if (comp(key, key_of(node))) {
+            node->left = remove(node->left, key);
+            return node;
+        }
+        else if (comp(key_of(node), key)) {
+            node->right = remove(node->right, key);
+            return node;
+        }
+        if (node->left == nullptr || node->right == nullptr) {
+            Node * tmp;
+            if (node->left == nullptr) {
+                tmp = node->right;
+            }
+            else {
+                tmp = node->left;
+            }
+            destroy_node(node);
+            return tmp;
+        }
+        Node * new_vertex = node->left;
+        if (new_vertex->right != nullptr) {
+            find_min(node->right, new_vertex->right->size)->left = new_vertex->right;
+        }
+        new_vertex->right = node->right;
+        destroy_node(node);
+
+        new_vertex->size = new_vertex->right->size + 1;
+        if (new_vertex->left != nullptr) {
+            new_vertex->size += new_vertex->left->size;
+        }
+        return new_vertex;
+    }
+
+    Node * find_min(Node * node, const int size) const
+    {
+        node->size += size;
+        while (node->left != nullptr) {
+            node = node->left;
+            node->size += size;
+        }
+        return node;
+    }
+
+    static std::size_t depth(const Node * node)
+    {
+        if (node == nullptr) {
+            return 0;
+        }
+        return 1 + std::max(depth(node->left), depth(node->right));
+    }
+
+    template <class F>
+    void for_each(const Node * node, F & f) const
+    {
+        if (node == nullptr) {
+            return;
+        }
+        for_each(node->left, f);
+        f(node->value);
+        for_each(node->right, f);
+    }
+
+    Node * check_rebuild(Node * node, const Key & key)
+    {
+        if (node == nullptr || equal(key_of(node), key)) {
+            return node;
+        }
+        int kf = node->size * tree_alpha;
+        if ((node->left != nullptr && kf < node->left->size) || (node->right != nullptr && kf < node->right->size)) {
+            const std::size_t count = node->size;
+            if constexpr (CollectStats) {
+                ++counters.rebuilds;
+                counters.rebuilt_nodes += count;
+            }
+            Node * vine = scapegoat_detail::flatten(node);
+            return scapegoat_detail::build_balanced_tree(vine, count);
+        }
+        if (comp(key, key_of(node))) {
+            node->left = check_rebuild(node->left, key);
+        }
+        else {
+            node->right = check_rebuild(node->right, key);
+        }
+        return node;
+    }
+};
@@ -0,0 +1,434 @@
+#pragma once
+
+#include "BasicScapegoatTree.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Scapegoat set for many reader threads and writers serialized among themselves.
+// Published nodes are immutable: a write copies the path it changes and every
+// subtree it rebuilds, then publishes the new root atomically. Readers pin a
+// snapshot of the root without locks; replaced nodes are freed by the writer
+// once no reader pinned an epoch that could still see them. Removal and
+// rebuilds follow BasicScapegoatTree, so both trees take the same shape.
+template <class Key, class Compare = std::less<Key>>
+class ConcurrentScapegoatSet
+{
+    struct Node
+    {
+        Node * left = nullptr;
+        Node * right = nullptr;
+        int size = 1;
+        std::uint64_t version = 0; // write operation that created the node
+        Key value;
+
+        Node(const Key & x, std::uint64_t v)
+            : version(v)
+            , value(x)
+        {
+        }
+    };
+
+    struct alignas(64) Slot
+    {
+        std::atomic<std::uint64_t> epoch{0}; // 0 - the slot is free
+    };
+
+public:
+    static constexpr std::size_t max_readers = 128;
+
+    // Consistent read-only view of the set, valid until destroyed.
+    // A thread should not hold more than one snapshot at a time for long:
+    // pinned snapshots delay freeing of replaced nodes.
+    class Snapshot
+    {
+        friend class ConcurrentScapegoatSet;
+
+        const ConcurrentScapegoatSet * set = nullptr;
+        Slot * slot = nullptr;
+        const Node * root = nullptr;
+
+        Snapshot(const ConcurrentScapegoatSet & s, Slot & pinned)
+            : set(&s)
+            , slot(&pinned)
+            , root(s.root.load())
+        {
+        }
+
+    public:
+        Snapshot(const Snapshot &) = delete;
+        Snapshot & operator=(const Snapshot &) = delete;
+
+        Snapshot(Snapshot && other) noexcept
+            : set(other.set)
+            , slot(std::exchange(other.slot, nullptr))
+            , root(other.root)
+        {
+        }
+
+        bool contains(const Key & key) const
+        {
+            return set->find(root, key) != nullptr;
+        }
+
+        std::size_t size() const
+        {
+            return root == nullptr ? 0 : root->size;
+        }
+
+        bool empty() const
+        {
+            return root == nullptr;
+        }
+
+        std::vector<Key> values() const
+        {
+            std::vector<Key> result;
+            result.reserve(size());
+            values(root, result);
+            return result;
+        }
+
+        ~Snapshot()
+        {
+            if (slot != nullptr) {
+                slot->epoch.store(0, std::memory_order_release);
+            }
+        }
+
+    private:
+        static void values(const Node * node, std::vector<Key> & ordered)
+        {
+            if (node == nullptr) {
+                return;
+            }
+            values(node->left, ordered);
+            ordered.push_back(node->value);
+            values(node->right, ordered);
+        }
+    };
+
+    ConcurrentScapegoatSet() = default;
+    ConcurrentScapegoatSet(double alpha, const Compare & compare = Compare())
+        : tree_alpha(alpha)
+        , comp(compare)
+    {
+        if (alpha < 0.5 || alpha > 1) {
+            throw std::invalid_argument("Invalid argument, alpha belongs to 0.5 to 1");
+        }
+    }
+
+    ConcurrentScapegoatSet(const ConcurrentScapegoatSet &) = delete;
+    ConcurrentScapegoatSet & operator=(const ConcurrentScapegoatSet &) = delete;
+
+    // Readers, lock-free unless more than max_readers snapshots are pinned at once
+
+    Snapshot snapshot() const
+    {
+        std::size_t i = std::hash<std::thread::id>()(std::this_thread::get_id()) % max_readers;
+        for (;;) {
+            for (std::size_t n = 0; n < max_readers; ++n, i = (i + 1) % max_readers) {
+                std::uint64_t expected = 0;
+                if (slots[i].epoch.load(std::memory_order_relaxed) == 0 &&
+                    slots[i].epoch.compare_exchange_strong(expected, global_epoch.load())) {
+                    return Snapshot(*this, slots[i]);
+                }
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    bool contains(const Key & key) const
+    {
+        return snapshot().contains(key);
+    }
+
+    std::size_t size() const
+    {
+        return tree_size.load(std::memory_order_relaxed);
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    std::vector<Key> values() const
+    {
+        return snapshot().values();
+    }
+
+    // Writers, serialized by an internal mutex which readers never take
+
+    bool insert(const Key & key)
+    {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        Node * node = root.load(std::memory_order_relaxed);
+        if (find(node, key) != nullptr) {
+            return false;
+        }
+        ++version;
+        try {
+            node = insert(node, key);
+            publish(check_rebuild(node, key), 1);
+        }
+        catch (...) {
+            rollback();
+            throw;
+        }
+        return true;
+    }
+
+    bool remove(const Key & key)
+    {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        Node * node = root.load(std::memory_order_relaxed);
+        if (find(node, key) == nullptr) {
+            return false;
+        }
+        ++version;
+        try {
+            node = remove(node, key);
+            publish(check_rebuild(node, key), -1);
+        }
+        catch (...) {
+            rollback();
+            throw;
+        }
+        return true;
+    }
+
+    // Must not run concurrently with any other call or live snapshot
+    ~ConcurrentScapegoatSet()
+    {
+        destroy(root.load());
+        for (auto & batch : limbo) {
+            for (Node * node : batch.second) {
+                delete node;
+            }
+        }
+    }
+
+private:
+    std::atomic<Node *> root{nullptr};
+    std::atomic<std::size_t> tree_size{0};
+    mutable std::atomic<std::uint64_t> global_epoch{1};
+    mutable std::array<Slot, max_readers> slots;
+    double tree_alpha = 0.75;
+    Compare comp;
+
+    // Writer state
+    std::mutex write_mutex;
+    std::uint64_t version = 0;
+    std::vector<Node *> retired;
+    std::vector<Node *> created; // nodes of the current operation, until it is published
+    std::deque<std::pair<std::uint64_t, std::vector<Node *>>> limbo;
+
+    const Node * find(const Node * node, const Key & key) const
+    {
+        while (node != nullptr) {
+            if (comp(key, node->value)) {
+                node = node->left;
+            }
+            else if (comp(node->value, key)) {
+                node = node->right;
+            }
+            else {
+                return node;
+            }
+        }
+        return nullptr;
+    }
+
+    static void destroy(Node * node)
+    {
+        if (node == nullptr) {
+            return;
+        }
+        destroy(node->left);
+        destroy(node->right);
+        delete node;
+    }
+
+    // The slot is reserved first, so a node is never allocated untracked
+    Node * create(const Key & x)
+    {
+        created.push_back(nullptr);
+        created.back() = new Node(x, version);
+        return created.back();
+    }
+
+    // Makes a node writable by the current operation: published nodes are
+    // copied and retired, nodes created by this operation are returned as is
+    Node * own(Node * node)
+    {
+        if (node->version == version) {
+            return node;
+        }
+        Node * copy = create(node->value);
+        copy->left = node->left;
+        copy->right = node->right;
+        copy->size = node->size;
+        retired.push_back(node);
+        return copy;
+    }
+
+    // Nothing may throw once the new root is stored
+    void publish(Node * new_root, int delta)
+    {
+        const bool retire = !retired.empty();
+        if (retire) {
+            limbo.emplace_back(std::numeric_limits<std::uint64_t>::max(), std::move(retired));
+            retired.clear();
+        }
+        root.store(new_root);
+        created.clear();
+        tree_size.fetch_add(delta, std::memory_order_relaxed);
+        const std::uint64_t epoch = global_epoch.fetch_add(1);
+        if (retire) {
+            limbo.back().first = epoch;
+        }
+        reclaim();
+    }
+
+    // Undoes a write that threw before publish: the published tree was not
+    // touched, so only the nodes made by the operation are freed
+    void rollback()
+    {
+        for (Node * node : created) {
+            delete node;
+        }
+        created.clear();
+        retired.clear();
+    }
+
+    // Frees nodes retired before the oldest epoch pinned by a reader
+    void reclaim()
+    {
+        std::uint64_t min_active = std::numeric_limits<std::uint64_t>::max();
+        for (const auto & slot : slots) {
+            const std::uint64_t epoch = slot.epoch.load();
+            if (epoch != 0) {
+                min_active = std::min(min_active, epoch);
+            }
+        }
+        while (!limbo.empty() && limbo.front().first < min_active) {
+            for (Node * node : limbo.front().second) {
+                delete node;
+            }
+            limbo.pop_front();
+        }
+    }
+
+    Node * insert(Node * node, const Key & key)
+    {
+        if (node == nullptr) {
+            return create(key);
+        }
+        node = own(node);
+        ++node->size;
+        if (comp(key, node->value)) {
+            node->left = insert(node->left, key);
+        }
+        else {
+            node->right = insert(node->right, key);
+        }
+        return node;
+    }
+
+    Node * remove(Node * node, const Key & key)
+    {
+        if (comp(key, node->value)) {
+            node = own(node);
+            --node->size;
+            node->left = remove(node->left, key);
+            return node;
+        }
+        else if (comp(node->value, key)) {
+            node = own(node);
+            --node->size;
+            node->right = remove(node->right, key);
+            return node;
+        }
+        retired.push_back(node);
+        if (node->left == nullptr) {
+            return node->right;
+        }
+        if (node->right == nullptr) {
+            return node->left;
+        }
+        // As in BasicScapegoatTree: the left child takes the place of the
+        // node and its right subtree goes under the minimum of the right one
+        Node * new_vertex = own(node->left);
+        Node * right = node->right;
+        if (new_vertex->right != nullptr) {
+            right = attach_to_min(right, new_vertex->right);
+        }
+        new_vertex->right = right;
+        new_vertex->size = right->size + 1;
+        if (new_vertex->left != nullptr) {
+            new_vertex->size += new_vertex->left->size;
+        }
+        return new_vertex;
+    }
+
+    // Copies the left spine of the subtree and hangs `leaf` off its end
+    Node * attach_to_min(Node * node, Node * leaf)
+    {
+        Node * top = own(node);
+        top->size += leaf->size;
+        Node * min = top;
+        while (min->left != nullptr) {
+            min->left = own(min->left);
+            min = min->left;
+            min->size += leaf->size;
+        }
+        min->left = leaf;
+        return top;
+    }
+
+    // Copies every published node of the subtree, so it may be relinked
+    Node * own_subtree(Node * node)
+    {
+        if (node == nullptr) {
+            return nullptr;
+        }
+        node = own(node);
+        node->left = own_subtree(node->left);
+        node->right = own_subtree(node->right);
+        return node;
+    }
+
+    // Walks only the nodes changed by the current operation: the rest of the
+    // tree is shared with snapshots and its sizes did not change
+    Node * check_rebuild(Node * node, const Key & key)
+    {
+        if (node == nullptr || node->version != version || (!comp(key, node->value) && !comp(node->value, key))) {
+            return node;
+        }
+        int kf = node->size * tree_alpha;
+        if ((node->left != nullptr && kf < node->left->size) || (node->right != nullptr && kf < node->right->size)) {
+            const std::size_t count = node->size;
+            Node * vine = scapegoat_detail::flatten(own_subtree(node));
+            return scapegoat_detail::build_balanced_tree(vine, count);
+        }
+        if (comp(key, node->value)) {
+            node->left = check_rebuild(node->left, key);
+        }
+        else {
+            node->right = check_rebuild(node->right, key);
+        }
+        return node;
+    }
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "BasicScapegoatTree.h"
+
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace scapegoat_detail {
+
+struct SelectFirst
+{
+    template <class Pair>
+    const typename Pair::first_type & operator()(const Pair & value) const
+    {
+        return value.first;
+    }
+};
+
+} // namespace scapegoat_detail
+
+template <class Key, class T, class Compare = std::less<Key>, class Alloc = std::allocator<std::pair<const Key, T>>, bool CollectStats = false>
+class ScapegoatMap : public BasicScapegoatTree<Key, std::pair<const Key, T>, scapegoat_detail::SelectFirst, Compare, Alloc, CollectStats>
+{
+    using Base = BasicScapegoatTree<Key, std::pair<const Key, T>, scapegoat_detail::SelectFirst, Compare, Alloc, CollectStats>;
+
+public:
+    using mapped_type = T;
+
+    using Base::Base;
+
+    // Unlike emplace, does not construct anything if the key is already present
+    template <class... Args>
+    bool try_emplace(const Key & key, Args &&... args)
+    {
+        return this->insert_unique(key,
+                                   std::piecewise_construct,
+                                   std::forward_as_tuple(key),
+                                   std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+
+    template <class... Args>
+    bool try_emplace(Key && key, Args &&... args)
+    {
+        return this->insert_unique(key,
+                                   std::piecewise_construct,
+                                   std::forward_as_tuple(std::move(key)),
+                                   std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+
+    T * find(const Key & key)
+    {
+        auto * node = this->find_node(key);
+        return node != nullptr ? &node->value.second : nullptr;
+    }
+
+    const T * find(const Key & key) const
+    {
+        const auto * node = this->find_node(key);
+        return node != nullptr ? &node->value.second : nullptr;
+    }
+
+    std::vector<Key> keys() const
+    {
+        std::vector<Key> result;
+        result.reserve(this->size());
+        this->for_each([&result](const auto & value) { result.push_back(value.first); });
+        return result;
+    }
+};
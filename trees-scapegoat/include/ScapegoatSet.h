@@ -0,0 +1,48 @@
+#pragma once
+
+#include "BasicScapegoatTree.h"
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace scapegoat_detail {
+
+struct Identity
+{
+    template <class T>
+    const T & operator()(const T & value) const
+    {
+        return value;
+    }
+};
+
+} // namespace scapegoat_detail
+
+template <class Key, class Compare = std::less<Key>, class Alloc = std::allocator<Key>, bool CollectStats = false>
+class ScapegoatSet : public BasicScapegoatTree<Key, Key, scapegoat_detail::Identity, Compare, Alloc, CollectStats>
+{
+    using Base = BasicScapegoatTree<Key, Key, scapegoat_detail::Identity, Compare, Alloc, CollectStats>;
+
+public:
+    using Base::Base;
+
+    bool insert(const Key & key)
+    {
+        return this->insert_unique(key, key);
+    }
+
+    bool insert(Key && key)
+    {
+        return this->insert_unique(key, std::move(key));
+    }
+
+    std::vector<Key> values() const
+    {
+        std::vector<Key> result;
+        result.reserve(this->size());
+        this->for_each([&result](const Key & key) { result.push_back(key); });
+        return result;
+    }
+};
@@ -0,0 +1,18 @@
+#include "ScapegoatMap.h"
+
+#include <memory>
+#include <string>
+
+// Not used by the library itself: instantiated so the build compiles every
+// member of the map, with a non-trivial key and a move-only value
+
+using StringMap = ScapegoatMap<std::string, std::unique_ptr<int>>;
+using StringMapValue = std::pair<const std::string, std::unique_ptr<int>>;
+using StringMapBase = BasicScapegoatTree<std::string, StringMapValue, scapegoat_detail::SelectFirst, std::less<std::string>, std::allocator<StringMapValue>>;
+
+template class BasicScapegoatTree<std::string, StringMapValue, scapegoat_detail::SelectFirst, std::less<std::string>, std::allocator<StringMapValue>>;
+template class ScapegoatMap<std::string, std::unique_ptr<int>>;
+
+template bool StringMapBase::emplace(std::string &&, std::unique_ptr<int> &&);
+template bool StringMap::try_emplace(const std::string &, std::unique_ptr<int> &&);
+template bool StringMap::try_emplace(std::string &&, std::unique_ptr<int> &&);